@@ -7,29 +7,85 @@
 #include <cmath>
 #include <cassert>
 #include <limits>
+#include <cstdint>
 #include <cstdlib>
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "csr_adjacency.h"
+#include "distance_table.h"
+#include "fast_input.h"
+#include "indexed_heap.h"
+#include "output_writer.h"
+#include "run_stats.h"
 
 #ifndef DEBUG
 #define printf // 
 #endif
 
+// Bitset of the unoccupied physical qubits, so the lowest free one is a
+// find-first-set instead of a scan over the whole device.
+class FreeQubits {
+private:
+    std::vector<uint64_t> words;
+    // no free qubit below this word
+    size_t lowest = 0;
+
+public:
+    FreeQubits(int size = 0) : words((size + 63) / 64, 0) {}
+
+    void assign(int qubit, bool isFree) {
+        size_t word = qubit >> 6;
+        uint64_t bit = uint64_t(1) << (qubit & 63);
+        if (isFree) {
+            words[word] |= bit;
+            lowest = std::min(lowest, word);
+        } else {
+            words[word] &= ~bit;
+        }
+    }
+
+    bool test(int qubit) const {
+        return (words[qubit >> 6] >> (qubit & 63)) & 1;
+    }
+
+    // lowest free qubit, -1 if none
+    int first() {
+        while (lowest < words.size() && words[lowest] == 0) {
+            lowest++;
+        }
+        if (lowest == words.size()) {
+            return -1;
+        }
+        return lowest * 64 + __builtin_ctzll(words[lowest]);
+    }
+};
+
 class BiDict {
 private:
     std::vector<int> forward;
     std::vector<int> reverse;
+    FreeQubits freeQubits;
+
+    void refresh(int phy) {
+        freeQubits.assign(phy, reverse[phy] == -1);
+    }
 
 public:
-    BiDict(int size) : forward(size), reverse(size) {}
+    BiDict(int size) : forward(size), reverse(size), freeQubits(size) {}
 
     void set(int key, int value) {
         forward[key] = value;
         reverse[key] = value;
+        refresh(key);
     }
 
     void setItem(int key, int value) {
         forward[key] = value;
         reverse[value] = key;
+        refresh(value);
     }
 
     int getItem(int key) {
@@ -44,6 +100,15 @@ public:
         return forward.size();
     }
 
+    bool isFree(int phy) const {
+        return freeQubits.test(phy);
+    }
+
+    // lowest unoccupied physical qubit, -1 if none
+    int firstFree() {
+        return freeQubits.first();
+    }
+
     void printMapping() {
         int i = 0;
         for(auto item : forward) {
@@ -71,88 +136,87 @@ public:
 
 class Graph {
 private:
-    std::vector<std::vector<int>> graph;
-    std::vector<int> inDegree;
+    CsrAdjacency graph;
 
 public:
     Graph() = default;
-    Graph(int n) : graph(n), inDegree(n, 0) {}
+    Graph(int n, const std::vector<std::pair<int, int>>& links) : graph(n, links, CsrAdjacency::kBoth) {}
+    explicit Graph(CsrAdjacency adjacency) : graph(std::move(adjacency)) {}
 
-    void addEdge(int node1, int node2) {
-        graph[node1].push_back(node2);
-        graph[node2].push_back(node1);
-        inDegree[node1]++;
-        inDegree[node2]++;
+    Span<const int> getNeighbor(int node) const {
+        return graph[node];
     }
 
-    const auto& getNeighbor(int node) const {
-        return graph[node];
+    int size() const {
+        return graph.size();
     }
 
-    std::vector<std::vector<int>> allPairDistances() const {
-        int n = graph.size();
-        std::vector<std::vector<int>> distances(n, std::vector<int>(n, -1));
-
-        for (int i = 0; i < n; i++) {
-            distances[i][i] = 0;
-            std::queue<int> q;
-            q.push(i);
-            std::vector<bool> visited(n, false);
-            visited[i] = true;
-
-            while (!q.empty()) {
-                int node = q.front();
-                q.pop();
-                for (const auto& neighbor : graph[node]) {
-                    if (!visited[neighbor]) {
-                        visited[neighbor] = true;
-                        distances[i][neighbor] = distances[neighbor][i] = distances[i][node] + 1;
-                        q.push(neighbor);
-                    }
-                }
-            }
-        }
+    DistanceTable allPairDistances() const {
+        return DistanceTable(*this);
+    }
+};
 
-        return distances;
+// Breadth-first search for the free physical qubit nearest to key, in plain
+// BFS order. Visit marks are epoch stamps and the queue is reused, so a search
+// only costs the nodes it reaches, and it stops as soon as it discovers a free
+// qubit instead of when that qubit is dequeued. There is no per-source
+// index: a search reaches a few dozen nodes even on large devices, while
+// building one source's BFS order would cost a whole-device BFS.
+class NearestQubitSearch {
+private:
+    std::vector<int> stamp;
+    std::vector<int> queue;
+    int epoch = 0;
+
+public:
+    NearestQubitSearch(int n) : stamp(n, 0) {
+        queue.reserve(n);
     }
 
-    friend int getNearestQubit(int key, BiDict& qubitMapping, const Graph& g);
-};
+    int find(int key, BiDict& qubitMapping, const Graph& g) {
+        STATS_ADD(nearestQubitCalls, 1);
+        STATS_ADD(nearestQubitNodes, 1);
+        if (qubitMapping.isFree(key)) {
+            return key;
+        }
+        if (qubitMapping.firstFree() == -1) {
+            return -1;
+        }
 
-int getNearestQubit(int key, BiDict& qubitMapping, const Graph& g) {
-    int n = g.graph.size();
-    std::queue<int> q;
-    q.push(key);
-    std::vector<bool> visited(n, false);
-    visited[key] = true;
-
-    while (!q.empty()) {
-        int node = q.front();
-        q.pop();
-        if(qubitMapping.getReverseItem(node) == -1) {
-            return node;
-        } else {
-            for (const auto& neighbor : g.graph[node]) {
-                // printf("%d neighbor %d\n", node, neighbor);
-                if (!visited[neighbor]) {
-                    visited[neighbor] = true;
-                    q.push(neighbor);
+        epoch++;
+        stamp[key] = epoch;
+        queue.clear();
+        queue.push_back(key);
+        for (size_t head = 0; head < queue.size(); head++) {
+            for (const auto& neighbor : g.getNeighbor(queue[head])) {
+                // printf("%d neighbor %d\n", queue[head], neighbor);
+                if (stamp[neighbor] != epoch) {
+                    stamp[neighbor] = epoch;
+                    STATS_ADD(nearestQubitNodes, 1);
+                    if (qubitMapping.isFree(neighbor)) {
+                        return neighbor;
+                    }
+                    queue.push_back(neighbor);
                 }
             }
         }
-    }
 
-    return -1;
-}
+        return -1;
+    }
+};
 
 void swapQubit(BiDict& qubitMapping, std::pair<int, int>& gate) {
     std::swap(qubitMapping.forward[gate.first], qubitMapping.forward[gate.second]);
     std::swap(qubitMapping.reverse[qubitMapping.forward[gate.first]], qubitMapping.reverse[qubitMapping.forward[gate.second]]);
+    qubitMapping.refresh(qubitMapping.forward[gate.first]);
+    qubitMapping.refresh(qubitMapping.forward[gate.second]);
 }
 
 void swapPhyQubit(BiDict& qubitMapping, std::pair<int, int>& gate) {
     std::swap(qubitMapping.reverse[gate.first], qubitMapping.reverse[gate.second]);
     std::swap(qubitMapping.forward[qubitMapping.reverse[gate.first]], qubitMapping.forward[qubitMapping.reverse[gate.second]]);
+    qubitMapping.refresh(gate.first);
+    qubitMapping.refresh(gate.second);
 }
 
 
@@ -168,15 +232,22 @@ void swapTmpQubit(BiDict& qubitMapping, std::pair<int, int>& gate) {
     // printf("known: %d, unknown %d\n", known, unknown);
     qubitMapping.forward[qubitMapping.reverse[known]] = unknown;
     std::swap(qubitMapping.reverse[gate.first], qubitMapping.reverse[gate.second]);
+    qubitMapping.refresh(gate.first);
+    qubitMapping.refresh(gate.second);
     // qubitMapping.printMapping();
 }
 
 std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<std::pair<int, int>>& gates, const std::vector<std::pair<int, int>>& dependencies, const Graph& g, BiDict& qubitMapping, int logQubits, int numGates) {
     
-    std::vector<std::vector<int>> dependencyGraph(numGates);
+    CsrAdjacency dependencyGraph(numGates, dependencies, CsrAdjacency::kForward);
     std::vector<int> inDegree(numGates, 0);
 
-    std::vector<std::vector<int>> allPairDistance = g.allPairDistances();
+    DistanceTable allPairDistance = [&] {
+        STATS_TIMER(kDistances);
+        return g.allPairDistances();
+    }();
+    STATS_TIMER(kRouting);
+    NearestQubitSearch nearestQubit(g.size());
     
     // set mark qubit as unallocated
     for (int i = 0; i < logQubits; ++i) {
@@ -184,10 +255,7 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
     }
 
     for (const auto& dependency : dependencies) {
-        int u = dependency.first;
-        int v = dependency.second;
-        dependencyGraph[u].push_back(v);
-        inDegree[v]++;
+        inDegree[dependency.second]++;
     }
 
     std::vector<std::pair<int, std::pair<int, int>>> operations;
@@ -195,7 +263,35 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
     std::queue<int> checkQueue;
     std::vector<int> executableQueue;
     std::vector<int> swapMap(logQubits, -2);
-    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> pq;
+    // blocked gates keyed by their current distance, and the blocked gates
+    // waiting on each logical qubit (usually at most one, when dependencies
+    // chain through each qubit's last use, but the input does not promise it)
+    IndexedHeap<> blocked(numGates);
+    std::vector<std::vector<int>> blockedOn(logQubits);
+
+    // re-key the gates waiting on a qubit the last SWAP moved, releasing
+    // those that became adjacent
+    auto touch = [&](int logical) {
+        if (logical == -1) {
+            return;
+        }
+        std::vector<int>& waiting = blockedOn[logical];
+        for (size_t i = 0; i < waiting.size();) {
+            int id = waiting[i];
+            int distance = allPairDistance[qubitMapping.getItem(gates[id].first)][qubitMapping.getItem(gates[id].second)];
+            STATS_ADD(distanceLookups, 1);
+            if (distance == 1) {
+                std::vector<int>& other = blockedOn[gates[id].first == logical ? gates[id].second : gates[id].first];
+                other.erase(std::find(other.begin(), other.end(), id));
+                waiting.erase(waiting.begin() + i);
+                blocked.erase(id);
+                checkQueue.push(id);
+            } else {
+                blocked.update(id, distance);
+                i++;
+            }
+        }
+    };
 
     // find all gate id without dependency
     for (int idx = 0; idx < numGates; idx++) {
@@ -208,19 +304,20 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
             // printf("log src %d -> %d\n", logSrc, qubitMapping.getReverseItem(logSrc));
             if(qubitMapping.getReverseItem(logSrc) != -1) {
                 // find the first phybit without lock
-                for(int i=0; i<qubitMapping.size(); i++) {
-                    if(qubitMapping.getReverseItem(i) == -1) {
-                        nearestNeighbor = i;
-                        // printf("neighbor %d\n", nearestNeighbor);
-                        break;
-                    }
+                nearestNeighbor = qubitMapping.firstFree();
+                // printf("neighbor %d\n", nearestNeighbor);
+                if (nearestNeighbor == -1) {
+                    throw std::runtime_error("no free physical qubit is left for a gate's first qubit");
                 }
                 qubitMapping.setItem(logSrc, nearestNeighbor);
             } else {
                 qubitMapping.setItem(logSrc, logSrc);
             }
 
-            nearestNeighbor = getNearestQubit(qubitMapping.getItem(logSrc), qubitMapping, g);
+            nearestNeighbor = nearestQubit.find(qubitMapping.getItem(logSrc), qubitMapping, g);
+            if (nearestNeighbor == -1) {
+                throw std::runtime_error("no free physical qubit is reachable for a gate's second qubit");
+            }
             qubitMapping.setItem(logDst, nearestNeighbor);
             // qubitMapping.printMapping();
 
@@ -248,16 +345,15 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
                 // printf("direct push candidate %d\n", candidate + 1);
             } else if(phySrc == -1 && phyDst == -1) {
                 // place first qubit at corresponding place and find neighbor
-                int neighbor;
-                for(int i=0; i<qubitMapping.size(); i++) {
-                    if(qubitMapping.getReverseItem(i) == -1) {
-                        neighbor = i;
-                        break;
-                    }
+                int neighbor = qubitMapping.firstFree();
+                if (neighbor == -1) {
+                    throw std::runtime_error("no free physical qubit is left for a gate's first qubit");
                 }
                 qubitMapping.setItem(logSrc, neighbor);
-                neighbor = getNearestQubit(qubitMapping.getItem(logSrc), qubitMapping, g);
-                assert(neighbor != -1);
+                neighbor = nearestQubit.find(qubitMapping.getItem(logSrc), qubitMapping, g);
+                if (neighbor == -1) {
+                    throw std::runtime_error("no free physical qubit is reachable for a gate's second qubit");
+                }
                 qubitMapping.setItem(logDst, neighbor);
                 // printf("set mapping %d->%d, %d->%d\n", logSrc, qubitMapping.getItem(logSrc), logDst, neighbor);
 
@@ -265,12 +361,15 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
                 int lockedQubit = (phyDst == -1) ? logSrc : logDst;
                 int movingQubit = (phyDst == -1) ? logDst : logSrc;
                 // printf("locked phybit %d, move phybit %d, lock qubit %d, move qubit %d\n", qubitMapping.getItem(lockedQubit), qubitMapping.getItem(movingQubit), lockedQubit, movingQubit);
-                int neighbor = getNearestQubit(qubitMapping.getItem(lockedQubit), qubitMapping, g);
-                assert(neighbor != -1);
+                int neighbor = nearestQubit.find(qubitMapping.getItem(lockedQubit), qubitMapping, g);
+                if (neighbor == -1) {
+                    throw std::runtime_error("no free physical qubit is reachable for a gate's second qubit");
+                }
                 qubitMapping.setItem(movingQubit, neighbor);
             }
 
             int distance = allPairDistance[qubitMapping.getItem(logSrc)][qubitMapping.getItem(logDst)];
+            STATS_ADD(distanceLookups, 1);
 
             if(distance == 1) {
                 // operations.push_back(std::make_pair(0, std::make_pair(logSrc, logDst)));
@@ -288,45 +387,59 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
                 // executableQueue.push_back(candidate);
                 // swapMap[logSrc] = candidate, swapMap[logDst] = candidate;
                 printf("put %d to pq with distance %d\n", candidate, distance);
-                pq.emplace(distance, candidate);
+                blocked.push(candidate, distance);
+                blockedOn[logSrc].push_back(candidate);
+                blockedOn[logDst].push_back(candidate);
             }
         }
 
-        if (pq.empty()) {
+        if (blocked.empty()) {
             break;
         }
 
 
+        STATS_ADD(swapIterations, 1);
+        STATS_FRONT(blocked.size());
         std::pair<int, int> bestSwap = std::make_pair(-2, -2), bestLogSwap;
+        // gates without an improving SWAP; only possible on a disconnected
+        // coupling graph since keys are current distances
         std::vector<std::pair<int, int>> unusedGate;
         int gateId;
 
-        printf("pq size %d\n", pq.size());
+        printf("pq size %d\n", blocked.size());
 
-        while (bestSwap.first == -2)
+        while (bestSwap.first == -2 && !blocked.empty())
         {
-            gateId = pq.top().second;
-            unusedGate.push_back(pq.top());
-            pq.pop();
+            gateId = blocked.top();
+            STATS_ADD(pqPops, 1);
             printf("pop %d from pq\n", gateId);
             
             const auto& gate = gates[gateId];
             const auto a = qubitMapping.getItem(gate.first), b = qubitMapping.getItem(gate.second);
             const auto distance = allPairDistance[a][b];
+            STATS_ADD(distanceLookups, 1);
             // printf("gate id %d, (%d, %d), (%d, %d), distance %d\n", gateId, a, b, gate.first, gate.second, distance);
 
             const auto& neighbors = g.getNeighbor(a);
 
             for(const auto& neighbor : neighbors) {
+                STATS_ADD(candidatesEvaluated, 1);
+                STATS_ADD(distanceLookups, 1);
                 // printf("candidate swap (%d, %d)\n", a, neighbor);
                 if(distance - allPairDistance[b][neighbor] > 0) {
                     bestSwap = std::make_pair(a, neighbor);
                     break;
                 }
             }
+            if (bestSwap.first == -2) {
+                unusedGate.emplace_back(gateId, blocked.key(gateId));
+                blocked.pop();
+            }
         }
 
-        assert(bestSwap.first != -2);
+        if (bestSwap.first == -2) {
+            throw std::runtime_error("no SWAP brings a blocked gate closer; the coupling graph is disconnected");
+        }
 
         // printf("best swap (%d, %d)\n", bestSwap.first, bestSwap.second);
         bestLogSwap = std::make_pair(qubitMapping.getReverseItem(bestSwap.first), qubitMapping.getReverseItem(bestSwap.second));
@@ -339,13 +452,14 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
             operations.emplace_back(1, bestLogSwap);
         }
         // qubitMapping.printMapping();
-        checkQueue.push(gateId);
 
-        unusedGate.pop_back();
         for(const auto& item : unusedGate) {
-            printf("add %d back to pq\n", item);
-            pq.push(item);
+            printf("add %d back to pq\n", item.first);
+            blocked.push(item.first, item.second);
+            STATS_ADD(pqRepushes, 1);
         }
+        touch(bestLogSwap.first);
+        touch(bestLogSwap.second);
         
     }
 
@@ -354,37 +468,53 @@ std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<st
 }
 
 
-int main() {
+int main(int argc, char** argv) {
     std::srand(42);
-    // std::ios::sync_with_stdio(false);
-    // std::cin.tie(nullptr);
-    int logQubits, numGates, numDependencies, phyQubits, numPhyLinks;
-    std::cin >> logQubits >> numGates >> numDependencies >> phyQubits >> numPhyLinks;
-
-    std::vector<std::pair<int, int>> gates(numGates);
-    for (int i = 0; i < numGates; ++i) {
-        int _, srcbit, dstbit;
-        std::cin >> _ >> srcbit >> dstbit;
-        gates[i] = std::make_pair(srcbit - 1, dstbit - 1);
+    std::string inputPath;
+    bool timing = false;
+    bool binary = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--timing") == 0) {
+            timing = true;
+        } else if (std::strcmp(argv[i], "--binary") == 0) {
+            binary = true;
+        } else {
+            inputPath = argv[i];
+        }
     }
 
-    std::vector<std::pair<int, int>> dependencies(numDependencies);
-    for (int i = 0; i < numDependencies; ++i) {
-        int _, srcgate, tgtgate;
-        std::cin >> _ >> srcgate >> tgtgate;
-        dependencies[i] = std::make_pair(srcgate - 1, tgtgate - 1);
+    InputBuffer input;
+    if (!input.open(inputPath)) {
+        std::fprintf(stderr, "cannot open %s\n", inputPath.c_str());
+        return 1;
     }
 
-    Graph g(logQubits);
-    for (int i = 0; i < numPhyLinks; ++i) {
-        int _, src, dst;
-        std::cin >> _ >> src >> dst;
-        g.addEdge(src - 1, dst - 1);
+    CircuitHeader header;
+    std::vector<std::pair<int, int>> gates;
+    std::vector<std::pair<int, int>> dependencies;
+    Graph g;
+    ParseStats parseStats;
+    {
+        STATS_TIMER(kParse);
+        if (!readCircuit(input, header, gates, dependencies, g, &parseStats)) {
+            std::fprintf(stderr, "malformed input\n");
+            return 1;
+        }
     }
+    if (timing) {
+        parseStats.report(stderr);
+    }
+    int logQubits = header.logQubits, numGates = header.numGates;
 
     BiDict qubitMapping(logQubits);
 
-    std::vector<std::pair<int, std::pair<int, int>>> operations = sabresSwap(gates, dependencies, g, qubitMapping, logQubits, numGates);
+    std::vector<std::pair<int, std::pair<int, int>>> operations;
+    try {
+        operations = sabresSwap(gates, dependencies, g, qubitMapping, logQubits, numGates);
+    } catch (const std::runtime_error& error) {
+        std::fprintf(stderr, "cannot route: %s\n", error.what());
+        return 1;
+    }
 
     // fill logQubit that does not have correspond phyQubit
     const auto& forward = qubitMapping.getForward();
@@ -421,17 +551,25 @@ int main() {
         }
     }
 
-    for (int i = 0; i < logQubits; ++i) {
-        std::cout << i + 1 << ' ' << qubitMapping.getItem(i) + 1 << '\n';
-    }
+    bool written;
+    {
+        STATS_TIMER(kOutput);
+        OutputWriter out(STDOUT_FILENO);
+        out.setBinary(binary);
+        out.begin(logQubits);
+        for (int i = 0; i < logQubits; ++i) {
+            out.mapping(i, qubitMapping.getItem(i));
+        }
 
-    for (const auto& op : operations) {
-        if (op.first == 0) {
-            std::cout << "CNOT q" << op.second.first + 1 << " q" << op.second.second + 1 << '\n';
-        } else {
-            std::cout << "SWAP q" << op.second.first + 1 << " q" << op.second.second + 1 << '\n';
+        for (const auto& op : operations) {
+            if (op.first == 0) {
+                out.cnot(op.second.first, op.second.second);
+            } else {
+                out.swap(op.second.first, op.second.second);
+            }
         }
+        written = out.close();
     }
-
-    return 0;
+    STATS_REPORT(stderr);
+    return written ? 0 : 1;
 }
\ No newline at end of file
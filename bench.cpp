@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "fast_input.h"
+#include "output_writer.h"
+#include "router.h"
+#include "router_flags.h"
+
+// In-process benchmark over the testset tiers. Every circuit is routed by a
+// Device and Router configured from the same flags as sabre_swap, each phase
+// timed on its own, and the per-phase median and p95 over the repetitions
+// are written as CSV or JSON so runs before and after a change can be diffed.
+
+enum Phase { kParse, kDistances, kPlacement, kRouting, kOutput, kTotal, kPhases };
+
+static const char* const kPhaseNames[kPhases] = {"parse", "distances", "placement", "routing", "output", "total"};
+
+struct FileResult {
+    std::string tier;
+    std::string name;
+    int logQubits = 0;
+    int cnots = 0;
+    int swaps = 0;
+    std::vector<double> samples[kPhases];
+    double median[kPhases] = {};
+    double p95[kPhases] = {};
+};
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// nearest-rank percentile
+static double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    int rank = std::max(1, (int)std::ceil(p * samples.size()));
+    return samples[rank - 1];
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        if (comma > start) {
+            items.push_back(list.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return items;
+}
+
+// one timed pass over path, filling ms per phase; false if the input is unreadable
+static bool runOnce(const std::string& path, const DeviceOptions& deviceOptions, const RouterOptions& options, OutputWriter& sinkFile, double* ms, int& logQubits, int& cnots, int& swaps) {
+    auto totalStart = std::chrono::steady_clock::now();
+
+    auto start = std::chrono::steady_clock::now();
+    InputBuffer input;
+    CircuitHeader header;
+    Circuit circuit;
+    Graph g;
+    if (!input.open(path) || !readCircuit(input, header, circuit.gates, circuit.dependencies, g)) {
+        return false;
+    }
+    circuit.logQubits = header.logQubits;
+    ms[kParse] = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    Device device(std::move(g), deviceOptions);
+    ms[kDistances] = msSince(start);
+
+    // operations are collected so that formatting is timed apart from routing
+    start = std::chrono::steady_clock::now();
+    Router router(device, options);
+    RoutingResult result = router.route(circuit);
+    ms[kPlacement] = result.placementSeconds * 1000;
+    ms[kRouting] = msSince(start) - ms[kPlacement];
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < circuit.logQubits; ++i) {
+        sinkFile.mapping(i, result.initialMapping.getItem(i));
+    }
+    for (const auto& op : result.operations) {
+        if (op.first == 1) {
+            sinkFile.cnot(op.second.first, op.second.second);
+        } else {
+            sinkFile.swap(op.second.first, op.second.second);
+        }
+    }
+    sinkFile.flush();
+    ms[kOutput] = msSince(start);
+
+    ms[kTotal] = msSince(totalStart);
+    logQubits = circuit.logQubits;
+    cnots = circuit.gates.size();
+    swaps = result.swaps;
+    return true;
+}
+
+static void writeCsv(FILE* out, const std::vector<FileResult>& results) {
+    std::fprintf(out, "tier,file,qubits,cnot,swap");
+    for (const char* phase : kPhaseNames) {
+        std::fprintf(out, ",%s_median_ms,%s_p95_ms", phase, phase);
+    }
+    std::fprintf(out, "\n");
+    for (const auto& result : results) {
+        std::fprintf(out, "%s,%s,%d,%d,%d", result.tier.c_str(), result.name.c_str(), result.logQubits, result.cnots, result.swaps);
+        for (int phase = 0; phase < kPhases; phase++) {
+            std::fprintf(out, ",%.4f,%.4f", result.median[phase], result.p95[phase]);
+        }
+        std::fprintf(out, "\n");
+    }
+}
+
+static void writeJson(FILE* out, const std::vector<FileResult>& results, int reps, int warmup) {
+    std::fprintf(out, "{\n  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"files\": [", reps, warmup);
+    for (size_t i = 0; i < results.size(); i++) {
+        const FileResult& result = results[i];
+        std::fprintf(out, "%s\n    {\"tier\": \"%s\", \"file\": \"%s\", \"qubits\": %d, \"cnot\": %d, \"swap\": %d", i ? "," : "", result.tier.c_str(), result.name.c_str(), result.logQubits, result.cnots, result.swaps);
+        for (int phase = 0; phase < kPhases; phase++) {
+            std::fprintf(out, ", \"%s\": {\"median_ms\": %.4f, \"p95_ms\": %.4f}", kPhaseNames[phase], result.median[phase], result.p95[phase]);
+        }
+        std::fprintf(out, "}");
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    std::string testset = "testset";
+    std::string tiers = "tiny,xsmall,small";
+    std::string format = "csv";
+    std::string outPath;
+    int reps = 5, warmup = 1, limit = 0;
+    DeviceOptions deviceOptions;
+    RouterOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--testset") == 0 && i + 1 < argc) {
+            testset = argv[++i];
+        } else if (std::strcmp(argv[i], "--tiers") == 0 && i + 1 < argc) {
+            // comma separated, e.g. tiny,xsmall,small,medium,large_v2
+            tiers = argv[++i];
+        } else if (std::strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            // first N files of each tier, 0 for all
+            limit = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (parseRouterFlag(argc, argv, i, deviceOptions, options)) {
+            continue;
+        } else {
+            std::fprintf(stderr, "usage: %s [--testset DIR] [--tiers a,b] [--reps N] [--warmup N] [--limit N] [--format csv|json] [--out FILE] %s\n", argv[0], kRouterFlagsUsage);
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json") {
+        std::fprintf(stderr, "unknown format %s\n", format.c_str());
+        return 1;
+    }
+
+    // output is formatted and written for real, into /dev/null
+    OutputWriter sinkFile;
+    if (!sinkFile.open("/dev/null")) {
+        std::fprintf(stderr, "cannot open /dev/null\n");
+        return 1;
+    }
+
+    std::vector<FileResult> results;
+    for (const auto& tier : splitList(tiers)) {
+        std::filesystem::path dir = std::filesystem::path(testset) / tier;
+        std::error_code error;
+        if (!std::filesystem::is_directory(dir, error)) {
+            std::fprintf(stderr, "%s: no such tier\n", dir.string().c_str());
+            return 1;
+        }
+        std::vector<std::string> files;
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        if (limit > 0 && (int)files.size() > limit) {
+            files.resize(limit);
+        }
+
+        double tierMs[kPhases] = {};
+        long long tierSwaps = 0;
+        for (const auto& path : files) {
+            FileResult result;
+            result.tier = tier;
+            result.name = std::filesystem::path(path).filename().string();
+            double ms[kPhases];
+            bool ok = true;
+            for (int rep = 0; ok && rep < warmup + reps; rep++) {
+                ok = runOnce(path, deviceOptions, options, sinkFile, ms, result.logQubits, result.cnots, result.swaps);
+                if (ok && rep >= warmup) {
+                    for (int phase = 0; phase < kPhases; phase++) {
+                        result.samples[phase].push_back(ms[phase]);
+                    }
+                }
+            }
+            if (!ok) {
+                std::fprintf(stderr, "%s: cannot read\n", path.c_str());
+                return 1;
+            }
+            for (int phase = 0; phase < kPhases; phase++) {
+                result.median[phase] = percentile(result.samples[phase], 0.5);
+                result.p95[phase] = percentile(result.samples[phase], 0.95);
+                tierMs[phase] += result.median[phase];
+            }
+            tierSwaps += result.swaps;
+            results.push_back(std::move(result));
+        }
+
+        std::fprintf(stderr, "%s: %d files, %lld SWAP, median ms", tier.c_str(), (int)files.size(), tierSwaps);
+        for (int phase = 0; phase < kPhases; phase++) {
+            std::fprintf(stderr, " %s %.3f", kPhaseNames[phase], tierMs[phase]);
+        }
+        std::fprintf(stderr, "\n");
+    }
+
+    FILE* out = stdout;
+    if (!outPath.empty() && !(out = std::fopen(outPath.c_str(), "w"))) {
+        std::fprintf(stderr, "cannot open %s\n", outPath.c_str());
+        return 1;
+    }
+    if (format == "csv") {
+        writeCsv(out, results);
+    } else {
+        writeJson(out, results, reps, warmup);
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
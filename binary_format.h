@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Versioned binary containers for circuits and routing results, laid out so
+// a read-only mmap of the file can be used in place. All integers are
+// little-endian, qubit and gate ids are 0-based, and every section starts on
+// a 4-byte boundary after a 64-byte header.
+//
+// Circuit: header, gates as (a, b) uint32 pairs, dependencies as
+// (before, after) uint32 gate pairs, the coupling graph as CSR (uint32
+// offsets[phyQubits + 1] then uint32 targets[numArcs], each node's
+// neighbours in the order a text reader would see them), and the original
+// links as uint32 pairs so text round trips keep their edge order.
+//
+// Result: header, the initial mapping as uint32 physical[logQubits], then
+// one (a, b) uint32 pair per operation on logical qubits, with
+// kSwapBit set in a for SWAPs. The operation count follows from the file
+// size, so results can be streamed into pipes.
+
+struct BinaryCircuitHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t logQubits;
+    uint32_t numGates;
+    uint32_t numDependencies;
+    uint32_t phyQubits;
+    uint32_t numLinks;
+    uint32_t numArcs;
+    uint32_t reserved;
+    uint64_t gatesOffset;
+    uint64_t dependenciesOffset;
+    uint64_t couplingOffset;
+};
+
+struct BinaryResultHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t logQubits;
+    uint64_t mappingOffset;
+    uint64_t opsOffset;
+};
+
+struct BinaryFormat {
+    static constexpr char kCircuitMagic[8] = {'S', 'A', 'B', 'R', 'E', 'C', 'I', 'R'};
+    static constexpr char kResultMagic[8] = {'S', 'A', 'B', 'R', 'E', 'R', 'E', 'S'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderBytes = 64;
+    static constexpr uint32_t kSwapBit = 0x80000000u;
+
+    static bool isCircuit(const char* data, size_t size) {
+        return size >= kHeaderBytes && std::memcmp(data, kCircuitMagic, sizeof(kCircuitMagic)) == 0;
+    }
+
+    static bool isResult(const char* data, size_t size) {
+        return size >= kHeaderBytes && std::memcmp(data, kResultMagic, sizeof(kResultMagic)) == 0;
+    }
+
+    // byte size of a circuit file and its section offsets, filled into header
+    static size_t circuitLayout(BinaryCircuitHeader& header) {
+        std::memcpy(header.magic, kCircuitMagic, sizeof(kCircuitMagic));
+        header.version = kVersion;
+        header.reserved = 0;
+        header.gatesOffset = kHeaderBytes;
+        header.dependenciesOffset = header.gatesOffset + 8ull * header.numGates;
+        header.couplingOffset = header.dependenciesOffset + 8ull * header.numDependencies;
+        return header.couplingOffset + 4ull * (header.phyQubits + 1) + 4ull * header.numArcs + 8ull * header.numLinks;
+    }
+
+    static void resultLayout(BinaryResultHeader& header) {
+        std::memcpy(header.magic, kResultMagic, sizeof(kResultMagic));
+        header.version = kVersion;
+        header.mappingOffset = kHeaderBytes;
+        header.opsOffset = kHeaderBytes + 4ull * header.logQubits;
+    }
+};
+
+static_assert(sizeof(BinaryCircuitHeader) <= BinaryFormat::kHeaderBytes, "circuit header too large");
+static_assert(sizeof(BinaryResultHeader) <= BinaryFormat::kHeaderBytes, "result header too large");
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "binary_format.h"
+#include "csr_adjacency.h"
+#include "fast_input.h"
+#include "output_writer.h"
+
+// Converts circuits and routing results between the text format and the
+// binary containers of binary_format.h. The direction follows from the
+// input: binary files become text, text becomes binary. Text circuits and
+// results are told apart by their first line (five numbers for a circuit
+// header, two for a mapping line).
+
+static bool writeAll(FILE* out, const void* data, size_t bytes) {
+    return std::fwrite(data, 1, bytes, out) == bytes;
+}
+
+static bool writePairs(FILE* out, const std::vector<std::pair<int, int>>& pairs) {
+    std::vector<uint32_t> packed;
+    packed.reserve(2 * pairs.size());
+    for (const auto& pair : pairs) {
+        packed.push_back(pair.first);
+        packed.push_back(pair.second);
+    }
+    return writeAll(out, packed.data(), packed.size() * sizeof(uint32_t));
+}
+
+static bool circuitToBinary(const InputBuffer& input, FILE* out) {
+    CircuitHeader header;
+    std::vector<std::pair<int, int>> gates, dependencies;
+    std::vector<std::pair<int, int>> links;
+    if (!readCircuit(input, header, gates, dependencies, links)) {
+        std::fprintf(stderr, "malformed circuit\n");
+        return false;
+    }
+    for (const auto& link : links) {
+        if (link.first < 0 || link.second < 0 || link.first >= header.phyQubits || link.second >= header.phyQubits) {
+            std::fprintf(stderr, "link out of range\n");
+            return false;
+        }
+    }
+
+    // neighbour lists in link order, as the router's Graph builds them
+    CsrAdjacency adjacency(header.phyQubits, links, CsrAdjacency::kBoth);
+    std::vector<uint32_t> offsets(1, 0);
+    std::vector<uint32_t> targets;
+    for (int i = 0; i < header.phyQubits; i++) {
+        targets.insert(targets.end(), adjacency[i].begin(), adjacency[i].end());
+        offsets.push_back(targets.size());
+    }
+
+    BinaryCircuitHeader binary{};
+    binary.logQubits = header.logQubits;
+    binary.numGates = header.numGates;
+    binary.numDependencies = header.numDependencies;
+    binary.phyQubits = header.phyQubits;
+    binary.numLinks = links.size();
+    binary.numArcs = targets.size();
+    BinaryFormat::circuitLayout(binary);
+    char block[BinaryFormat::kHeaderBytes] = {};
+    std::memcpy(block, &binary, sizeof(binary));
+
+    return writeAll(out, block, sizeof(block)) && writePairs(out, gates) && writePairs(out, dependencies) && writeAll(out, offsets.data(), offsets.size() * sizeof(uint32_t)) && writeAll(out, targets.data(), targets.size() * sizeof(uint32_t)) && writePairs(out, links);
+}
+
+static bool circuitToText(const InputBuffer& input, FILE* out) {
+    CircuitHeader header;
+    std::vector<std::pair<int, int>> gates, dependencies;
+    std::vector<std::pair<int, int>> links;
+    if (!readCircuit(input, header, gates, dependencies, links)) {
+        std::fprintf(stderr, "corrupt binary circuit\n");
+        return false;
+    }
+    std::fprintf(out, "%d %d %d %d %d\n", header.logQubits, header.numGates, header.numDependencies, header.phyQubits, header.numPhyLinks);
+    for (size_t i = 0; i < gates.size(); i++) {
+        std::fprintf(out, "%zu %d %d\n", i + 1, gates[i].first + 1, gates[i].second + 1);
+    }
+    for (size_t i = 0; i < dependencies.size(); i++) {
+        std::fprintf(out, "%zu %d %d\n", i + 1, dependencies[i].first + 1, dependencies[i].second + 1);
+    }
+    for (size_t i = 0; i < links.size(); i++) {
+        std::fprintf(out, "%zu %d %d\n", i + 1, links[i].first + 1, links[i].second + 1);
+    }
+    return !std::ferror(out);
+}
+
+static bool resultToBinary(const InputBuffer& input, OutputWriter& out) {
+    // mapping lines until the first operation
+    std::vector<int> mapping;
+    const char* cur = input.begin();
+    const char* end = input.end();
+    auto nextLine = [&](const char*& begin, const char*& stop) {
+        while (cur < end && (*cur == '\n' || *cur == '\r' || *cur == ' ')) {
+            cur++;
+        }
+        begin = cur;
+        while (cur < end && *cur != '\n') {
+            cur++;
+        }
+        stop = cur;
+        return begin < stop;
+    };
+    const char* begin;
+    const char* stop;
+    std::vector<std::pair<int, int>> pairs;
+    while (true) {
+        const char* save = cur;
+        if (!nextLine(begin, stop)) {
+            break;
+        }
+        if (*begin == 'C' || *begin == 'S') {
+            cur = save;
+            break;
+        }
+        Scanner in(begin, stop);
+        int logical = in.nextInt();
+        int physical = in.nextInt();
+        if (!in.ok() || logical < 1) {
+            std::fprintf(stderr, "malformed mapping line\n");
+            return false;
+        }
+        pairs.push_back(std::make_pair(logical - 1, physical - 1));
+    }
+    // a result carries no coupling, so the mapping is checked to be a
+    // one-to-one map of every logical qubit, as the verifier requires
+    mapping.assign(pairs.size(), -1);
+    std::vector<std::pair<int, int>> byPhysical;
+    for (const auto& pair : pairs) {
+        if (pair.first >= (int)mapping.size() || pair.second < 0) {
+            std::fprintf(stderr, "mapping qubit out of range\n");
+            return false;
+        }
+        if (mapping[pair.first] != -1) {
+            std::fprintf(stderr, "mapping is not one-to-one\n");
+            return false;
+        }
+        mapping[pair.first] = pair.second;
+        byPhysical.push_back(std::make_pair(pair.second, pair.first));
+    }
+    std::sort(byPhysical.begin(), byPhysical.end());
+    for (size_t i = 1; i < byPhysical.size(); i++) {
+        if (byPhysical[i].first == byPhysical[i - 1].first) {
+            std::fprintf(stderr, "mapping is not one-to-one\n");
+            return false;
+        }
+    }
+    int logQubits = mapping.size();
+
+    out.setBinary(true);
+    out.begin(mapping.size());
+    for (size_t i = 0; i < mapping.size(); i++) {
+        out.mapping(i, mapping[i]);
+    }
+    while (nextLine(begin, stop)) {
+        bool swap = std::strncmp(begin, "SWAP", 4) == 0;
+        if (!swap && std::strncmp(begin, "CNOT", 4) != 0) {
+            std::fprintf(stderr, "unknown operation\n");
+            return false;
+        }
+        Scanner in(begin + 4, stop);
+        int a = in.nextInt('q');
+        int b = in.nextInt('q');
+        if (!in.ok()) {
+            std::fprintf(stderr, "malformed operation\n");
+            return false;
+        }
+        if (a < 1 || b < 1 || a > logQubits || b > logQubits || a == b) {
+            std::fprintf(stderr, "bad operands q%d q%d\n", a, b);
+            return false;
+        }
+        if (swap) {
+            out.swap(a - 1, b - 1);
+        } else {
+            out.cnot(a - 1, b - 1);
+        }
+    }
+    return out.close();
+}
+
+static bool resultToText(const InputBuffer& input, OutputWriter& out) {
+    const BinaryResultHeader* header = reinterpret_cast<const BinaryResultHeader*>(input.begin());
+    BinaryResultHeader expected = *header;
+    BinaryFormat::resultLayout(expected);
+    size_t opBytes = input.size() - std::min(input.size(), (size_t)expected.opsOffset);
+    if (header->version != BinaryFormat::kVersion || std::memcmp(header, &expected, sizeof(expected)) != 0 || input.size() < expected.opsOffset || opBytes % 8 != 0) {
+        std::fprintf(stderr, "corrupt binary result\n");
+        return false;
+    }
+    const uint32_t* mapping = binarySection(input, header->mappingOffset);
+    for (uint32_t i = 0; i < header->logQubits; i++) {
+        out.mapping(i, mapping[i]);
+    }
+    const uint32_t* ops = binarySection(input, header->opsOffset);
+    for (size_t i = 0; i < opBytes / 8; i++) {
+        uint32_t a = ops[2 * i], b = ops[2 * i + 1];
+        if (a & BinaryFormat::kSwapBit) {
+            out.swap(a & ~BinaryFormat::kSwapBit, b);
+        } else {
+            out.cnot(a, b);
+        }
+    }
+    return out.close();
+}
+
+// count of numbers on the first line of a text file
+static int firstLineFields(const InputBuffer& input) {
+    const char* cur = input.begin();
+    while (cur < input.end() && (*cur == '\n' || *cur == '\r')) {
+        cur++;
+    }
+    const char* stop = cur;
+    while (stop < input.end() && *stop != '\n') {
+        stop++;
+    }
+    Scanner in(cur, stop);
+    int fields = 0;
+    while (true) {
+        in.nextInt();
+        if (!in.ok()) {
+            return fields;
+        }
+        fields++;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <input> <output>   (\"-\" for stdin/stdout)\n", argv[0]);
+        return 1;
+    }
+    std::string inputPath = argv[1], outputPath = argv[2];
+    InputBuffer input;
+    if (!input.open(inputPath)) {
+        std::fprintf(stderr, "cannot open %s\n", inputPath.c_str());
+        return 1;
+    }
+
+    bool circuitIn = BinaryFormat::isCircuit(input.begin(), input.size());
+    bool resultIn = BinaryFormat::isResult(input.begin(), input.size());
+    bool ok;
+    if (circuitIn || (!resultIn && firstLineFields(input) == 5)) {
+        FILE* file = outputPath == "-" ? stdout : std::fopen(outputPath.c_str(), "wb");
+        if (!file) {
+            std::fprintf(stderr, "cannot open %s\n", outputPath.c_str());
+            return 1;
+        }
+        ok = circuitIn ? circuitToText(input, file) : circuitToBinary(input, file);
+        if (std::fclose(file) != 0) {
+            ok = false;
+        }
+    } else {
+        OutputWriter out(STDOUT_FILENO);
+        if (outputPath != "-" && !out.open(outputPath)) {
+            std::fprintf(stderr, "cannot open %s\n", outputPath.c_str());
+            return 1;
+        }
+        ok = resultIn ? resultToText(input, out) : resultToBinary(input, out);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "span.h"
+
+// Adjacency lists packed into one array: the neighbours of node i are
+// targets[offsets[i] .. offsets[i + 1]). Built from an edge list in two
+// counting passes, so every node keeps its neighbours in edge-list order,
+// the same order per-node push_back would give.
+class CsrAdjacency {
+private:
+    std::vector<int> offsets;
+    std::vector<int> targets;
+
+public:
+    // kForward stores a -> b for each edge (a, b), kBackward b -> a, kBoth both
+    enum Direction { kForward, kBackward, kBoth };
+
+    CsrAdjacency() : offsets(1, 0) {}
+
+    CsrAdjacency(int n, const std::vector<std::pair<int, int>>& edges, Direction direction) : offsets(n + 1, 0) {
+        for (const auto& edge : edges) {
+            if (direction != kBackward) {
+                offsets[edge.first + 1]++;
+            }
+            if (direction != kForward) {
+                offsets[edge.second + 1]++;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+        targets.resize(offsets[n]);
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for (const auto& edge : edges) {
+            if (direction != kBackward) {
+                targets[fill[edge.first]++] = edge.second;
+            }
+            if (direction != kForward) {
+                targets[fill[edge.second]++] = edge.first;
+            }
+        }
+    }
+
+    // copied from arrays already in this form: packedOffsets[n + 1], then
+    // packedTargets[packedOffsets[n]]
+    CsrAdjacency(int n, const uint32_t* packedOffsets, const uint32_t* packedTargets)
+        : offsets(packedOffsets, packedOffsets + n + 1), targets(packedTargets, packedTargets + packedOffsets[n]) {}
+
+    Span<const int> operator[](int node) const {
+        return Span<const int>(targets.data() + offsets[node], offsets[node + 1] - offsets[node]);
+    }
+
+    int degree(int node) const {
+        return offsets[node + 1] - offsets[node];
+    }
+
+    int maxDegree() const {
+        int best = 0;
+        for (int i = 0; i + 1 < (int)offsets.size(); i++) {
+            best = std::max(best, degree(i));
+        }
+        return best;
+    }
+
+    int size() const {
+        return offsets.size() - 1;
+    }
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "distance_table.h"
+
+// On-disk DistanceTable cache. Each coupling graph is stored as
+// <dir>/<hash>.dist: a fixed header, the graph's key (see graphKey) padded
+// to 64 bytes, then the raw row-major table, mapped read-only on later runs.
+// A file is used only when its stored key equals the graph's, so two graphs
+// whose hashes collide never share a table.
+class DistanceCache {
+private:
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t n;
+        uint32_t elemBytes;
+        uint32_t keyWords;
+        uint64_t hash;
+        uint64_t dataOffset;
+    };
+
+    static constexpr char kMagic[8] = {'S', 'A', 'B', 'R', 'E', 'D', 'S', 'T'};
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint64_t kHeaderBytes = 64;
+
+    static uint64_t dataOffset(size_t keyWords) {
+        return kHeaderBytes + (keyWords * sizeof(uint32_t) + 63) / 64 * 64;
+    }
+
+    std::string dir;
+
+public:
+    explicit DistanceCache(std::string dir) : dir(std::move(dir)) {}
+
+    // n, then each node's degree and sorted neighbours. Two graphs have
+    // equal keys exactly when they have the same links, whatever the order
+    // and direction of the links in the input.
+    static std::vector<uint32_t> graphKey(const FlatAdjacency& adj) {
+        std::vector<uint32_t> key;
+        key.push_back(adj.n);
+        for (int i = 0; i < adj.n; i++) {
+            Span<const int> neighbors = adj.adjacency[i];
+            key.push_back(neighbors.size());
+            size_t begin = key.size();
+            key.insert(key.end(), neighbors.begin(), neighbors.end());
+            std::sort(key.begin() + begin, key.end());
+        }
+        return key;
+    }
+
+    // FNV-1a over the graph key
+    static uint64_t graphHash(const std::vector<uint32_t>& key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t value : key) {
+            for (int i = 0; i < 4; i++) {
+                hash ^= (value >> (8 * i)) & 0xff;
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    std::string cachePath(uint64_t hash) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.dist", (unsigned long long)hash);
+        return dir + "/" + name;
+    }
+
+    static std::shared_ptr<const DistanceTable> load(const std::string& path, const FlatAdjacency& adj, const std::vector<uint32_t>& key, uint64_t hash) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        uint64_t offset = dataOffset(key.size());
+        size_t expected = offset + (size_t)adj.n * adj.n * adj.elementBytes();
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+            close(fd);
+            return nullptr;
+        }
+        void* addr = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return nullptr;
+        }
+        std::shared_ptr<const void> owner(addr, [expected](const void* p) {
+            munmap(const_cast<void*>(p), expected);
+        });
+
+        const FileHeader* header = static_cast<const FileHeader*>(addr);
+        if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion || header->n != (uint32_t)adj.n || header->elemBytes != (uint32_t)adj.elementBytes() || header->hash != hash || header->keyWords != key.size() || header->dataOffset != offset) {
+            return nullptr;
+        }
+        // a hash collision: the file belongs to another graph
+        if (std::memcmp(static_cast<const uint8_t*>(addr) + kHeaderBytes, key.data(), key.size() * sizeof(uint32_t)) != 0) {
+            return nullptr;
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(addr) + offset;
+        return std::make_shared<const DistanceTable>(DistanceTable::fromMapping(adj.n, adj.elementBytes(), data, std::move(owner)));
+    }
+
+    // write to a private temporary then rename, so readers only ever see complete files
+    bool store(const std::string& path, const DistanceTable& table, const std::vector<uint32_t>& key, uint64_t hash) const {
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.n = table.size();
+        header.elemBytes = table.elementBytes();
+        header.hash = hash;
+        header.keyWords = key.size();
+        header.dataOffset = dataOffset(key.size());
+        std::vector<uint8_t> block(header.dataOffset, 0);
+        std::memcpy(block.data(), &header, sizeof(header));
+        std::memcpy(block.data() + kHeaderBytes, key.data(), key.size() * sizeof(uint32_t));
+
+        auto writeAll = [&](const uint8_t* p, size_t left) {
+            while (left > 0) {
+                ssize_t written = write(fd, p, left);
+                if (written <= 0) {
+                    return false;
+                }
+                p += written;
+                left -= written;
+            }
+            return true;
+        };
+        bool ok = writeAll(block.data(), block.size()) && writeAll(table.bytes(), table.byteSize());
+        ok = ok && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // mapped table from dir when present, otherwise computed and written back
+    std::shared_ptr<const DistanceTable> loadOrBuild(const FlatAdjacency& adj) const {
+        std::vector<uint32_t> key = graphKey(adj);
+        uint64_t hash = graphHash(key);
+        std::string path = cachePath(hash);
+        if (auto table = load(path, adj, key, hash)) {
+            return table;
+        }
+        auto table = std::make_shared<const DistanceTable>(adj);
+        if (!store(path, *table, key, hash)) {
+            std::fprintf(stderr, "distance cache: cannot write %s\n", path.c_str());
+        }
+        return table;
+    }
+};
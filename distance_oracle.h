@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "distance_cache.h"
+#include "distance_table.h"
+
+// Distance lookups for the router, either served from a shared full
+// DistanceTable or computed one BFS row at a time into a size-capped LRU
+// cache when the full table would not fit the memory budget.
+//
+// In lazy mode a Row stays valid only until the next operator[] call, and
+// the oracle must not be shared between threads; copies start with an
+// empty cache of their own.
+class DistanceOracle {
+private:
+    std::shared_ptr<const DistanceTable> table;
+
+    std::shared_ptr<const FlatAdjacency> adj;
+    int n = 0;
+    int elemBytes = 1;
+    int capacity = 0;
+    mutable std::vector<uint8_t> rows;
+    mutable std::vector<int> slotOfRow;
+    mutable std::vector<int> rowOfSlot;
+    mutable std::vector<int> prev, next;
+    mutable int head = -1, tail = -1, used = 0;
+    mutable std::vector<int> bfsQueue;
+    mutable size_t hitCount = 0, missCount = 0;
+
+    void unlink(int slot) const {
+        if (prev[slot] != -1) next[prev[slot]] = next[slot]; else head = next[slot];
+        if (next[slot] != -1) prev[next[slot]] = prev[slot]; else tail = prev[slot];
+    }
+
+    void pushFront(int slot) const {
+        prev[slot] = -1;
+        next[slot] = head;
+        if (head != -1) prev[head] = slot; else tail = slot;
+        head = slot;
+    }
+
+    template <typename T>
+    void computeRow(int source, T* out) const {
+        std::fill(out, out + n, T(~T(0)));
+        out[source] = 0;
+        bfsQueue.clear();
+        bfsQueue.push_back(source);
+        for (size_t front = 0; front < bfsQueue.size(); front++) {
+            int node = bfsQueue[front];
+            for (int neighbor : adj->adjacency[node]) {
+                if (out[neighbor] == T(~T(0))) {
+                    out[neighbor] = out[node] + 1;
+                    bfsQueue.push_back(neighbor);
+                }
+            }
+        }
+    }
+
+    DistanceTable::Row cachedRow(int i) const {
+        int slot = slotOfRow[i];
+        if (slot != -1) {
+            hitCount++;
+            if (slot != head) {
+                unlink(slot);
+                pushFront(slot);
+            }
+        } else {
+            missCount++;
+            if (used < capacity) {
+                slot = used++;
+            } else {
+                slot = tail;
+                unlink(slot);
+                slotOfRow[rowOfSlot[slot]] = -1;
+            }
+            rowOfSlot[slot] = i;
+            slotOfRow[i] = slot;
+            pushFront(slot);
+            uint8_t* out = rows.data() + (size_t)slot * n * elemBytes;
+            if (elemBytes == 1) {
+                computeRow(i, out);
+            } else {
+                computeRow(i, reinterpret_cast<uint16_t*>(out));
+            }
+        }
+        return DistanceTable::Row(rows.data() + (size_t)slot * n * elemBytes, elemBytes == 2);
+    }
+
+public:
+    DistanceOracle() = default;
+
+    explicit DistanceOracle(std::shared_ptr<const DistanceTable> table) : table(std::move(table)) {}
+
+    // lazy oracle keeping at most cacheRows BFS rows (at least 2)
+    DistanceOracle(std::shared_ptr<const FlatAdjacency> adjacency, int cacheRows) : adj(std::move(adjacency)) {
+        n = adj->n;
+        elemBytes = adj->elementBytes();
+        capacity = std::max(2, std::min(cacheRows, n));
+        slotOfRow.assign(n, -1);
+        rowOfSlot.assign(capacity, -1);
+        prev.assign(capacity, -1);
+        next.assign(capacity, -1);
+        rows.resize((size_t)capacity * n * elemBytes);
+    }
+
+    DistanceOracle(const DistanceOracle& other) {
+        *this = other;
+    }
+
+    DistanceOracle& operator=(const DistanceOracle& other) {
+        if (other.table) {
+            table = other.table;
+            adj = nullptr;
+        } else if (other.adj) {
+            *this = DistanceOracle(other.adj, other.capacity);
+        } else {
+            // a default-constructed oracle has neither
+            *this = DistanceOracle();
+        }
+        return *this;
+    }
+
+    DistanceOracle(DistanceOracle&&) = default;
+    DistanceOracle& operator=(DistanceOracle&&) = default;
+
+    // full table when n*n distances fit budgetBytes (0 means no limit), lazy rows otherwise.
+    // A non-empty cacheDir maps the full table from / persists it to an on-disk DistanceCache.
+    template <class G>
+    static DistanceOracle build(const G& g, size_t budgetBytes, const std::string& cacheDir = "") {
+        auto adjacency = std::make_shared<const FlatAdjacency>(g);
+        size_t rowBytes = (size_t)adjacency->n * adjacency->elementBytes();
+        if (budgetBytes == 0 || rowBytes * adjacency->n <= budgetBytes) {
+            if (!cacheDir.empty()) {
+                return DistanceOracle(DistanceCache(cacheDir).loadOrBuild(*adjacency));
+            }
+            return DistanceOracle(std::make_shared<const DistanceTable>(*adjacency));
+        }
+        return DistanceOracle(adjacency, (int)(budgetBytes / rowBytes));
+    }
+
+    DistanceTable::Row operator[](int i) const {
+        if (table) {
+            return (*table)[i];
+        }
+        return cachedRow(i);
+    }
+
+    // the shared full table, nullptr in lazy mode
+    const DistanceTable* fullTable() const {
+        return table.get();
+    }
+
+    bool isMapped() const {
+        return table && table->isMapped();
+    }
+
+    bool isLazy() const {
+        return !table;
+    }
+
+    int cachedRows() const {
+        return capacity;
+    }
+
+    size_t hits() const {
+        return hitCount;
+    }
+
+    size_t misses() const {
+        return missCount;
+    }
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "csr_adjacency.h"
+
+// Coupling graph copied into a CsrAdjacency for the BFS kernels.
+struct FlatAdjacency {
+    int n = 0;
+    CsrAdjacency adjacency;
+    int elemBytes = 1;
+
+    template <class G>
+    explicit FlatAdjacency(const G& g) : n(g.size()) {
+        // one arc per neighbour, so every node keeps g's neighbour order
+        std::vector<std::pair<int, int>> arcs;
+        for (int i = 0; i < n; i++) {
+            for (int neighbor : g.getNeighbor(i)) {
+                arcs.emplace_back(i, neighbor);
+            }
+        }
+        adjacency = CsrAdjacency(n, arcs, CsrAdjacency::kForward);
+        elemBytes = diameterBound() < 0xff ? 1 : 2;
+    }
+
+    // twice the largest eccentricity of one root per component bounds the diameter
+    int diameterBound() const {
+        std::vector<int> level(n, -1);
+        std::queue<int> q;
+        int bound = 0;
+        for (int root = 0; root < n; root++) {
+            if (level[root] != -1) {
+                continue;
+            }
+            level[root] = 0;
+            q.push(root);
+            int ecc = 0;
+            while (!q.empty()) {
+                int node = q.front();
+                q.pop();
+                ecc = level[node];
+                for (int neighbor : adjacency[node]) {
+                    if (level[neighbor] == -1) {
+                        level[neighbor] = level[node] + 1;
+                        q.push(neighbor);
+                    }
+                }
+            }
+            bound = std::max(bound, 2 * ecc);
+        }
+        return bound;
+    }
+
+    // narrowest distance element that holds every finite distance plus the unreachable marker
+    int elementBytes() const {
+        return elemBytes;
+    }
+};
+
+// All-pairs hop distances of the coupling graph in one contiguous row-major
+// buffer. Elements are uint8_t unless the graph diameter does not fit, then
+// uint16_t. Unreachable pairs read as unreachable().
+class DistanceTable {
+private:
+    int n = 0;
+    int elemBytes = 1;
+    std::vector<uint8_t> storage;
+    const uint8_t* data = nullptr;
+    std::shared_ptr<const void> mapping;
+
+    // BFS from the 64 sources base..base+63 at once, one bit per source
+    template <typename T>
+    static void bfsBatch(const FlatAdjacency& adj, int n, int base, T* out, std::vector<uint64_t>& visited, std::vector<uint64_t>& frontier, std::vector<uint64_t>& next) {
+        int count = std::min(64, n - base);
+        std::fill(visited.begin(), visited.end(), 0);
+        std::fill(frontier.begin(), frontier.end(), 0);
+        for (int b = 0; b < count; b++) {
+            visited[base + b] = frontier[base + b] = uint64_t(1) << b;
+            out[(size_t)(base + b) * n + base + b] = 0;
+        }
+
+        for (T distance = 1; ; distance++) {
+            bool changed = false;
+            for (int v = 0; v < n; v++) {
+                uint64_t reach = 0;
+                for (int neighbor : adj.adjacency[v]) {
+                    reach |= frontier[neighbor];
+                }
+                reach &= ~visited[v];
+                next[v] = reach;
+                if (reach) {
+                    changed = true;
+                    visited[v] |= reach;
+                    while (reach) {
+                        int b = __builtin_ctzll(reach);
+                        reach &= reach - 1;
+                        out[(size_t)(base + b) * n + v] = distance;
+                    }
+                }
+            }
+            if (!changed) {
+                break;
+            }
+            frontier.swap(next);
+        }
+    }
+
+    template <typename T>
+    void fill(const FlatAdjacency& adj, int threads) {
+        T* out = reinterpret_cast<T*>(storage.data());
+        std::fill(out, out + (size_t)n * n, T(~T(0)));
+
+        int batches = (n + 63) / 64;
+        std::atomic<int> nextBatch(0);
+        auto worker = [&]() {
+            std::vector<uint64_t> visited(n), frontier(n), next(n);
+            for (int batch = nextBatch++; batch < batches; batch = nextBatch++) {
+                bfsBatch(adj, n, batch * 64, out, visited, frontier, next);
+            }
+        };
+
+        threads = std::max(1, std::min(threads, batches));
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; i++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+
+public:
+    class Row {
+    private:
+        const uint8_t* p;
+        bool wide;
+
+    public:
+        Row(const uint8_t* p, bool wide) : p(p), wide(wide) {}
+
+        int operator[](int j) const {
+            return wide ? reinterpret_cast<const uint16_t*>(p)[j] : p[j];
+        }
+
+        bool isWide() const {
+            return wide;
+        }
+
+        // raw elements for kernels that branch on isWide() once per row
+        template <typename T>
+        const T* elements() const {
+            return reinterpret_cast<const T*>(p);
+        }
+    };
+
+    DistanceTable() = default;
+
+    // threads <= 0 uses every hardware thread
+    template <class G>
+    explicit DistanceTable(const G& g, int threads = 0) : DistanceTable(FlatAdjacency(g), threads) {}
+
+    explicit DistanceTable(const FlatAdjacency& adj, int threads = 0) : n(adj.n) {
+        elemBytes = adj.elementBytes();
+        storage.resize((size_t)n * n * elemBytes);
+        data = storage.data();
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (elemBytes == 1) {
+            fill<uint8_t>(adj, threads);
+        } else {
+            fill<uint16_t>(adj, threads);
+        }
+    }
+
+    DistanceTable(DistanceTable&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    DistanceTable& operator=(DistanceTable&& other) noexcept {
+        n = other.n;
+        elemBytes = other.elemBytes;
+        bool owned = other.data == other.storage.data();
+        storage = std::move(other.storage);
+        mapping = std::move(other.mapping);
+        data = owned ? storage.data() : other.data;
+        other.data = nullptr;
+        other.n = 0;
+        return *this;
+    }
+
+    // view over distances owned by someone else, e.g. a read-only file mapping kept alive by owner
+    static DistanceTable fromMapping(int n, int elemBytes, const uint8_t* data, std::shared_ptr<const void> owner) {
+        DistanceTable table;
+        table.n = n;
+        table.elemBytes = elemBytes;
+        table.data = data;
+        table.mapping = std::move(owner);
+        return table;
+    }
+
+    Row operator[](int i) const {
+        return Row(data + (size_t)i * n * elemBytes, elemBytes == 2);
+    }
+
+    int size() const {
+        return n;
+    }
+
+    int elementBytes() const {
+        return elemBytes;
+    }
+
+    const uint8_t* bytes() const {
+        return data;
+    }
+
+    size_t byteSize() const {
+        return (size_t)n * n * elemBytes;
+    }
+
+    bool isMapped() const {
+        return mapping != nullptr;
+    }
+
+    int unreachable() const {
+        return elemBytes == 1 ? 0xff : 0xffff;
+    }
+};
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary_format.h"
+#include "csr_adjacency.h"
+
+// Whole-input buffer for the router front ends. Regular files (including a
+// redirected stdin) are mapped read-only, pipes are slurped into one block.
+class InputBuffer {
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::vector<char> storage;
+
+    void load(int fd) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(addr);
+                length = st.st_size;
+                mapped = true;
+                return;
+            }
+        }
+
+        storage.resize(1 << 20);
+        size_t used = 0;
+        while (true) {
+            if (used == storage.size()) {
+                storage.resize(storage.size() * 2);
+            }
+            ssize_t got = read(fd, storage.data() + used, storage.size() - used);
+            if (got <= 0) {
+                break;
+            }
+            used += got;
+        }
+        data = storage.data();
+        length = used;
+    }
+
+public:
+    InputBuffer() = default;
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // empty path or "-" reads stdin
+    bool open(const std::string& path) {
+        if (path.empty() || path == "-") {
+            load(STDIN_FILENO);
+            return true;
+        }
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        load(fd);
+        close(fd);
+        return true;
+    }
+
+    ~InputBuffer() {
+        if (mapped) {
+            munmap(const_cast<char*>(data), length);
+        }
+    }
+
+    const char* begin() const {
+        return data;
+    }
+
+    const char* end() const {
+        return data + length;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+// Hand-written scanner for the whitespace separated non-negative integers the
+// testset format consists of. Anything else where a number should start or
+// end, such as a sign or stray text, fails the scan.
+class Scanner {
+private:
+    const char* cur;
+    const char* last;
+    bool failed = false;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+    }
+
+    static bool isDigit(char c) {
+        return (unsigned char)(c - '0') <= 9;
+    }
+
+public:
+    Scanner(const char* begin, const char* end) : cur(begin), last(end) {}
+
+    // prefix, when given, may precede the digits (the q of "q12")
+    int nextInt(char prefix = 0) {
+        while (cur < last && isSpace(*cur)) {
+            cur++;
+        }
+        if (prefix && cur < last && *cur == prefix) {
+            cur++;
+        }
+        if (cur == last || !isDigit(*cur)) {
+            failed = true;
+            return 0;
+        }
+        int value = 0;
+        while (cur < last && isDigit(*cur)) {
+            value = value * 10 + (*cur - '0');
+            cur++;
+        }
+        if (cur < last && !isSpace(*cur)) {
+            failed = true;
+        }
+        return value;
+    }
+
+    bool ok() const {
+        return !failed;
+    }
+};
+
+struct CircuitHeader {
+    int logQubits = 0, numGates = 0, numDependencies = 0, phyQubits = 0, numPhyLinks = 0;
+};
+
+struct ParseStats {
+    size_t bytes = 0;
+    double seconds = 0;
+
+    void report(FILE* out) const {
+        double mb = bytes / (1024.0 * 1024.0);
+        std::fprintf(out, "parse: %.2f MiB in %.3f ms (%.1f MiB/s)\n", mb, seconds * 1e3, seconds > 0 ? mb / seconds : 0.0);
+    }
+};
+
+inline const uint32_t* binarySection(const InputBuffer& input, uint64_t offset) {
+    return reinterpret_cast<const uint32_t*>(input.begin() + offset);
+}
+
+// every id in count packed values is below limit
+inline bool idsBelow(const uint32_t* packed, uint64_t count, uint32_t limit) {
+    for (uint64_t i = 0; i < count; ++i) {
+        if (packed[i] >= limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Header of the binary circuit in input (see binary_format.h), nullptr when
+// input is text. A binary file with a bad header or size, an id out of range
+// or a malformed CSR section sets corrupt, so readers can index with the
+// stored ids unchecked.
+inline const BinaryCircuitHeader* binaryCircuit(const InputBuffer& input, bool& corrupt) {
+    corrupt = false;
+    if (!BinaryFormat::isCircuit(input.begin(), input.size())) {
+        return nullptr;
+    }
+    const BinaryCircuitHeader* header = reinterpret_cast<const BinaryCircuitHeader*>(input.begin());
+    BinaryCircuitHeader expected = *header;
+    size_t bytes = BinaryFormat::circuitLayout(expected);
+    if (header->version != BinaryFormat::kVersion || bytes != input.size() || std::memcmp(header, &expected, sizeof(expected)) != 0 || header->numArcs != 2 * header->numLinks) {
+        corrupt = true;
+        return nullptr;
+    }
+
+    const uint32_t* offsets = binarySection(input, header->couplingOffset);
+    const uint32_t* targets = offsets + header->phyQubits + 1;
+    const uint32_t* links = targets + header->numArcs;
+    bool csr = offsets[0] == 0 && offsets[header->phyQubits] == header->numArcs;
+    for (uint32_t i = 0; csr && i < header->phyQubits; ++i) {
+        csr = offsets[i] <= offsets[i + 1];
+    }
+    if (!csr || !idsBelow(binarySection(input, header->gatesOffset), 2ull * header->numGates, header->logQubits) ||
+        !idsBelow(binarySection(input, header->dependenciesOffset), 2ull * header->numDependencies, header->numGates) ||
+        !idsBelow(targets, header->numArcs, header->phyQubits) || !idsBelow(links, 2ull * header->numLinks, header->phyQubits)) {
+        corrupt = true;
+        return nullptr;
+    }
+    return header;
+}
+
+// coupling graph G built from the 0-based link list; a plain link vector as G
+// keeps the list itself, in file order
+template <class G>
+void buildCoupling(G& g, int n, std::vector<std::pair<int, int>>& links) {
+    g = G(n, links);
+}
+
+inline void buildCoupling(std::vector<std::pair<int, int>>& g, int, std::vector<std::pair<int, int>>& links) {
+    g = std::move(links);
+}
+
+// A G that can be built from a CsrAdjacency takes the stored CSR section
+// as is; any other G goes through buildCoupling with the stored link list.
+template <class G>
+void readBinaryCoupling(const InputBuffer& input, const BinaryCircuitHeader& binary, G& g) {
+    const uint32_t* offsets = binarySection(input, binary.couplingOffset);
+    const uint32_t* targets = offsets + binary.phyQubits + 1;
+    if constexpr (std::is_constructible<G, CsrAdjacency>::value) {
+        g = G(CsrAdjacency(binary.phyQubits, offsets, targets));
+    } else {
+        const uint32_t* packedLinks = targets + binary.numArcs;
+        std::vector<std::pair<int, int>> links(binary.numLinks);
+        for (uint32_t i = 0; i < binary.numLinks; ++i) {
+            links[i] = std::make_pair((int)packedLinks[2 * i], (int)packedLinks[2 * i + 1]);
+        }
+        buildCoupling(g, binary.phyQubits, links);
+    }
+}
+
+template <class G>
+bool readBinaryCircuit(const InputBuffer& input, const BinaryCircuitHeader& binary, CircuitHeader& header, std::vector<std::pair<int, int>>& gates, std::vector<std::pair<int, int>>& dependencies, G& g) {
+    header.logQubits = binary.logQubits;
+    header.numGates = binary.numGates;
+    header.numDependencies = binary.numDependencies;
+    header.phyQubits = binary.phyQubits;
+    header.numPhyLinks = binary.numLinks;
+
+    const uint32_t* packedGates = binarySection(input, binary.gatesOffset);
+    gates.resize(header.numGates);
+    for (int i = 0; i < header.numGates; ++i) {
+        gates[i] = std::make_pair((int)packedGates[2 * i], (int)packedGates[2 * i + 1]);
+    }
+    const uint32_t* packedDependencies = binarySection(input, binary.dependenciesOffset);
+    dependencies.resize(header.numDependencies);
+    for (int i = 0; i < header.numDependencies; ++i) {
+        dependencies[i] = std::make_pair((int)packedDependencies[2 * i], (int)packedDependencies[2 * i + 1]);
+    }
+    readBinaryCoupling(input, binary, g);
+    return true;
+}
+
+// Parse a whole testcase into the router structures. Ids in the file are
+// 1-based, everything stored here is 0-based. G is built by buildCoupling
+// from the 0-based link list in file order. Binary circuits are read from their
+// packed sections instead (see readBinaryCoupling for G).
+template <class G>
+bool readCircuit(const InputBuffer& input, CircuitHeader& header, std::vector<std::pair<int, int>>& gates, std::vector<std::pair<int, int>>& dependencies, G& g, ParseStats* stats = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    bool corrupt;
+    if (const BinaryCircuitHeader* binary = binaryCircuit(input, corrupt)) {
+        readBinaryCircuit(input, *binary, header, gates, dependencies, g);
+        if (stats) {
+            stats->bytes = input.size();
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return true;
+    }
+    if (corrupt) {
+        return false;
+    }
+    Scanner in(input.begin(), input.end());
+
+    header.logQubits = in.nextInt();
+    header.numGates = in.nextInt();
+    header.numDependencies = in.nextInt();
+    header.phyQubits = in.nextInt();
+    header.numPhyLinks = in.nextInt();
+    if (!in.ok()) {
+        return false;
+    }
+
+    gates.resize(header.numGates);
+    for (auto& gate : gates) {
+        in.nextInt();
+        int srcbit = in.nextInt();
+        int dstbit = in.nextInt();
+        gate = std::make_pair(srcbit - 1, dstbit - 1);
+    }
+
+    dependencies.resize(header.numDependencies);
+    for (auto& dependency : dependencies) {
+        in.nextInt();
+        int srcgate = in.nextInt();
+        int tgtgate = in.nextInt();
+        dependency = std::make_pair(srcgate - 1, tgtgate - 1);
+    }
+
+    std::vector<std::pair<int, int>> links(header.numPhyLinks);
+    for (auto& link : links) {
+        in.nextInt();
+        int src = in.nextInt();
+        int dst = in.nextInt();
+        link = std::make_pair(src - 1, dst - 1);
+    }
+    if (!in.ok()) {
+        return false;
+    }
+    buildCoupling(g, header.logQubits, links);
+
+    if (stats) {
+        stats->bytes = input.size();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+// Reads a testcase front to back without keeping it: open() parses the
+// header and the coupling map, skipping over the gate and dependency
+// sections in between, and next() then hands out the gates in batches.
+// The file's dependencies are never stored; streaming callers derive them
+// from last use per qubit, which is how the generator produced them. Binary
+// circuits hand out their packed gates directly.
+class CircuitStream {
+private:
+    Scanner in;
+    const uint32_t* packedGates = nullptr;
+    int gatesLeft = 0;
+    const InputBuffer& input;
+
+public:
+    explicit CircuitStream(const InputBuffer& input) : in(input.begin(), input.end()), input(input) {}
+
+    template <class G>
+    bool open(CircuitHeader& header, G& g) {
+        bool corrupt;
+        if (const BinaryCircuitHeader* binary = binaryCircuit(input, corrupt)) {
+            header.logQubits = binary->logQubits;
+            header.numGates = binary->numGates;
+            header.numDependencies = binary->numDependencies;
+            header.phyQubits = binary->phyQubits;
+            header.numPhyLinks = binary->numLinks;
+            packedGates = binarySection(input, binary->gatesOffset);
+            gatesLeft = header.numGates;
+            readBinaryCoupling(input, *binary, g);
+            return true;
+        }
+        if (corrupt) {
+            return false;
+        }
+
+        header.logQubits = in.nextInt();
+        header.numGates = in.nextInt();
+        header.numDependencies = in.nextInt();
+        header.phyQubits = in.nextInt();
+        header.numPhyLinks = in.nextInt();
+        if (!in.ok()) {
+            return false;
+        }
+        gatesLeft = header.numGates;
+
+        Scanner links = in;
+        for (long long i = 0; i < 3LL * (header.numGates + header.numDependencies); ++i) {
+            links.nextInt();
+        }
+        std::vector<std::pair<int, int>> edges(header.numPhyLinks);
+        for (auto& edge : edges) {
+            links.nextInt();
+            int src = links.nextInt();
+            int dst = links.nextInt();
+            edge = std::make_pair(src - 1, dst - 1);
+        }
+        if (!links.ok()) {
+            return false;
+        }
+        buildCoupling(g, header.logQubits, edges);
+        return true;
+    }
+
+    // append up to maxCount 0-based gates, returns how many were read
+    int next(std::vector<std::pair<int, int>>& gates, int maxCount) {
+        int count = std::min(maxCount, gatesLeft);
+        if (packedGates) {
+            for (int i = 0; i < count; ++i) {
+                gates.push_back(std::make_pair((int)packedGates[2 * i], (int)packedGates[2 * i + 1]));
+            }
+            packedGates += 2 * count;
+            gatesLeft -= count;
+            return count;
+        }
+        for (int i = 0; i < count; ++i) {
+            in.nextInt();
+            int srcbit = in.nextInt();
+            int dstbit = in.nextInt();
+            gates.push_back(std::make_pair(srcbit - 1, dstbit - 1));
+        }
+        gatesLeft -= count;
+        return in.ok() ? count : 0;
+    }
+};
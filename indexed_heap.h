@@ -0,0 +1,118 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Binary heap over the ids 0..n-1 with an int key per id. The top is the id
+// whose (key, id) pair comes first under Compare, and keys of queued ids can
+// be raised or lowered in place.
+template <class Compare = std::less<std::pair<int, int>>>
+class IndexedHeap {
+private:
+    std::vector<int> heap;
+    std::vector<int> position;
+    std::vector<int> keys;
+    Compare compare;
+
+    bool before(int a, int b) const {
+        return compare(std::make_pair(keys[a], a), std::make_pair(keys[b], b));
+    }
+
+    void place(int slot, int id) {
+        heap[slot] = id;
+        position[id] = slot;
+    }
+
+    void siftUp(int slot) {
+        int id = heap[slot];
+        while (slot > 0) {
+            int parent = (slot - 1) / 2;
+            if (!before(id, heap[parent])) {
+                break;
+            }
+            place(slot, heap[parent]);
+            slot = parent;
+        }
+        place(slot, id);
+    }
+
+    void siftDown(int slot) {
+        int id = heap[slot];
+        int n = heap.size();
+        while (true) {
+            int child = 2 * slot + 1;
+            if (child >= n) {
+                break;
+            }
+            if (child + 1 < n && before(heap[child + 1], heap[child])) {
+                child++;
+            }
+            if (!before(heap[child], id)) {
+                break;
+            }
+            place(slot, heap[child]);
+            slot = child;
+        }
+        place(slot, id);
+    }
+
+public:
+    explicit IndexedHeap(int n) : position(n, -1), keys(n, 0) {
+        heap.reserve(n);
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    int size() const {
+        return heap.size();
+    }
+
+    bool contains(int id) const {
+        return position[id] != -1;
+    }
+
+    int key(int id) const {
+        return keys[id];
+    }
+
+    int top() const {
+        return heap.front();
+    }
+
+    void push(int id, int key) {
+        keys[id] = key;
+        heap.push_back(id);
+        position[id] = heap.size() - 1;
+        siftUp(heap.size() - 1);
+    }
+
+    // change the key of a queued id, or queue it
+    void update(int id, int key) {
+        if (!contains(id)) {
+            push(id, key);
+            return;
+        }
+        keys[id] = key;
+        siftUp(position[id]);
+        siftDown(position[id]);
+    }
+
+    void erase(int id) {
+        int slot = position[id];
+        int last = heap.back();
+        heap.pop_back();
+        position[id] = -1;
+        if (last != id) {
+            place(slot, last);
+            siftUp(slot);
+            siftDown(position[last]);
+        }
+    }
+
+    void pop() {
+        erase(heap.front());
+    }
+};
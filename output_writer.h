@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "binary_format.h"
+
+// Router output formatted by hand into one reusable buffer, handed to the
+// kernel with a single write() per full chunk. Qubits are passed 0-based and
+// written 1-based. In binary mode the same calls produce a binary result
+// (see binary_format.h); begin() must then precede the mapping.
+class OutputWriter {
+private:
+    static constexpr size_t kChunk = 1 << 20;
+    // longest line: "SWAP q" + 10 digits + " q" + 10 digits + '\n'
+    static constexpr size_t kMaxLine = 32;
+
+    int fd = -1;
+    bool ownsFd = false;
+    bool failed = false;
+    bool binary = false;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    void reserve() {
+        if (used + kMaxLine > buffer.size()) {
+            flush();
+        }
+    }
+
+    void put(char c) {
+        buffer[used++] = c;
+    }
+
+    void put(const char* s, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            buffer[used + i] = s[i];
+        }
+        used += len;
+    }
+
+    void putInt(unsigned value) {
+        char digits[10];
+        int len = 0;
+        do {
+            digits[len++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (len) {
+            buffer[used++] = digits[--len];
+        }
+    }
+
+    void putWord(uint32_t value) {
+        std::memcpy(buffer.data() + used, &value, sizeof(value));
+        used += sizeof(value);
+    }
+
+    void gate(const char* name, int a, int b) {
+        reserve();
+        if (binary) {
+            putWord(name[0] == 'S' ? a | BinaryFormat::kSwapBit : a);
+            putWord(b);
+            return;
+        }
+        put(name, 6);
+        putInt(a + 1);
+        put(" q", 2);
+        putInt(b + 1);
+        put('\n');
+    }
+
+public:
+    // writes to fd, which stays open; -1 until open() is called
+    explicit OutputWriter(int fd = -1) : fd(fd), buffer(kChunk) {}
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    ~OutputWriter() {
+        close();
+    }
+
+    // truncate or create path and write to it
+    bool open(const std::string& path) {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ownsFd = fd >= 0;
+        failed = fd < 0;
+        return !failed;
+    }
+
+    void setBinary(bool enabled) {
+        binary = enabled;
+    }
+
+    bool isBinary() const {
+        return binary;
+    }
+
+    // start a result for logQubits logical qubits; writes the binary header
+    void begin(int logQubits) {
+        if (!binary) {
+            return;
+        }
+        BinaryResultHeader header{};
+        header.logQubits = logQubits;
+        BinaryFormat::resultLayout(header);
+        char block[BinaryFormat::kHeaderBytes] = {};
+        std::memcpy(block, &header, sizeof(header));
+        for (size_t offset = 0; offset < sizeof(block); offset += kMaxLine) {
+            reserve();
+            put(block + offset, kMaxLine);
+        }
+    }
+
+    // mappings must come in logical order
+    void mapping(int logical, int physical) {
+        reserve();
+        if (binary) {
+            putWord(physical);
+            return;
+        }
+        putInt(logical + 1);
+        put(' ');
+        putInt(physical + 1);
+        put('\n');
+    }
+
+    void cnot(int a, int b) {
+        gate("CNOT q", a, b);
+    }
+
+    void swap(int a, int b) {
+        gate("SWAP q", a, b);
+    }
+
+    bool flush() {
+        const char* p = buffer.data();
+        size_t left = used;
+        while (!failed && left > 0) {
+            ssize_t written = ::write(fd, p, left);
+            if (written <= 0) {
+                failed = true;
+                break;
+            }
+            p += written;
+            left -= written;
+        }
+        used = 0;
+        return !failed;
+    }
+
+    // flush, and close the file if open() opened it
+    bool close() {
+        if (fd < 0) {
+            return !failed;
+        }
+        flush();
+        if (ownsFd && ::close(fd) != 0) {
+            failed = true;
+        }
+        fd = -1;
+        ownsFd = false;
+        return !failed;
+    }
+
+    bool ok() const {
+        return !failed;
+    }
+};
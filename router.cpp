@@ -0,0 +1,1007 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cassert>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "indexed_heap.h"
+#include "router.h"
+#include "run_stats.h"
+#include "scratch_arena.h"
+
+
+void swapQubit(BiDict& qubitMapping, std::pair<int, int> gate) {
+    std::swap(qubitMapping.forward[gate.first], qubitMapping.forward[gate.second]);
+    std::swap(qubitMapping.reverse[qubitMapping.forward[gate.first]], qubitMapping.reverse[qubitMapping.forward[gate.second]]);
+}
+
+// qubit interaction counts in compressed sparse rows, neighbours sorted by id
+struct FrequencyGraph {
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<int> weights;
+
+    int weight(int u, int v) const {
+        auto first = targets.begin() + offsets[u], last = targets.begin() + offsets[u + 1];
+        auto it = std::lower_bound(first, last, v);
+        return (it != last && *it == v) ? weights[it - targets.begin()] : 0;
+    }
+
+    int weightSum(int u) const {
+        int sum = 0;
+        for (int k = offsets[u]; k < offsets[u + 1]; k++) {
+            sum += weights[k];
+        }
+        return sum;
+    }
+};
+
+FrequencyGraph getFrequencyGraph(const std::vector<std::pair<int, int>>& gates, int n) {
+    CsrAdjacency endpoints(n, gates, CsrAdjacency::kBoth);
+
+    // merge repeated pairs into weights
+    FrequencyGraph F;
+    F.offsets.assign(n + 1, 0);
+    std::vector<int> row;
+    for(int i=0;i<n;i++) {
+        row.assign(endpoints[i].begin(), endpoints[i].end());
+        auto first = row.begin(), last = row.end();
+        std::sort(first, last);
+        for(auto it = first; it != last; it++) {
+            if(it != first && *it == *(it - 1)) {
+                F.weights.back()++;
+            } else {
+                F.targets.push_back(*it);
+                F.weights.push_back(1);
+            }
+        }
+        F.offsets[i + 1] = F.targets.size();
+    }
+    return F;
+}
+
+// min Fsum first, the highest id wins ties
+struct PeelOrder {
+    bool operator()(const std::pair<int, int>& a, const std::pair<int, int>& b) const {
+        return a.first != b.first ? a.first < b.first : a.second > b.second;
+    }
+};
+
+std::vector<int> sortQubits(const FrequencyGraph& F, int logQubits) {
+    std::vector<int> queue;
+    IndexedHeap<PeelOrder> qubits(logQubits);
+    for (int i = 0; i < logQubits; i++) {
+        qubits.push(i, F.weightSum(i));
+    }
+
+    // repeatedly peel the least connected qubit and discount its links from the rest
+    while(!qubits.empty()) {
+        int best = qubits.top();
+        qubits.pop();
+        queue.push_back(best);
+        for(int k = F.offsets[best]; k < F.offsets[best + 1]; k++) {
+            int j = F.targets[k];
+            if(qubits.contains(j)) {
+                qubits.update(j, qubits.key(j) - F.weights[k]);
+            }
+        }
+    }
+
+    std::reverse(queue.begin(), queue.end());
+
+    // for(auto i : queue) {
+    //     printf("%d ", i);
+    // }
+    // printf("\n");
+
+    return queue;
+}
+
+// cost[p] += weight * row[p] for p in [lo, hi), branching on the element width once
+void addScaledRow(std::vector<int>& cost, const DistanceTable::Row& row, int weight, int lo, int hi) {
+    STATS_ADD(distanceLookups, hi - lo);
+    int* out = cost.data();
+    if(row.isWide()) {
+        const uint16_t* in = row.elements<uint16_t>();
+        for(int p = lo; p < hi; p++) out[p] += weight * in[p];
+    } else {
+        const uint8_t* in = row.elements<uint8_t>();
+        for(int p = lo; p < hi; p++) out[p] += weight * in[p];
+    }
+}
+
+// lowest cost in [lo, hi), the highest id wins ties
+std::pair<int, int> minCost(const std::vector<int>& cost, int lo, int hi) {
+    std::pair<int, int> best = std::make_pair(INT_MAX, -1);
+    for(int p = hi - 1; p >= lo; p--) {
+        if(cost[p] < best.first) {
+            best = std::make_pair(cost[p], p);
+        }
+    }
+    return best;
+}
+
+// Place the qubits in sortQubits order, each on the free physical qubit
+// minimising sum(weight * distance) to its already placed interaction
+// neighbours. Only those neighbours' distance rows are touched, and with a
+// pool and a full distance table the scan is split into fixed chunks whose
+// results merge in chunk order, so the layout does not depend on the thread count.
+void allocateQubit(const std::vector<std::pair<int, int>>& gates, const DistanceOracle& allPairDistance, const Graph& g, BiDict& qubitMapping, int logQubits, ThreadPool* pool) {
+    const int kChunk = 1024;
+    FrequencyGraph F = getFrequencyGraph(gates, logQubits);
+    std::vector<int> queue = sortQubits(F, logQubits);
+    int maxInDegree = g.maxInDegree();
+
+    // occupied physical qubits start at a cost no placement can beat
+    std::vector<int> baseCost(logQubits, 0);
+    std::vector<char> placed(logQubits, 0);
+
+    qubitMapping.setItem(queue[0], maxInDegree);
+    // printf("%d->%d\n", queue[0], qubitMapping.getItem(queue[0]));
+    placed[queue[0]] = 1;
+    baseCost[maxInDegree] = INT_MAX / 2;
+
+    bool parallel = pool && pool->size() > 1 && !allPairDistance.isLazy() && logQubits >= 2 * kChunk;
+    int chunks = (logQubits + kChunk - 1) / kChunk;
+    std::vector<int> cost(logQubits);
+    std::vector<std::pair<DistanceTable::Row, int>> rows;
+    std::vector<std::pair<int, int>> chunkBest(chunks);
+
+    for(int i=1; i < queue.size(); i++) {
+        int qubit = queue[i];
+        // printf("add qubit %d\n", qubit);
+        std::pair<int, int> best;
+        if(parallel) {
+            rows.clear();
+            for(int k = F.offsets[qubit]; k < F.offsets[qubit + 1]; k++) {
+                if(placed[F.targets[k]]) {
+                    rows.emplace_back(allPairDistance[qubitMapping.getItem(F.targets[k])], F.weights[k]);
+                }
+            }
+            pool->parallelFor(chunks, [&](int c) {
+                int lo = c * kChunk, hi = std::min(logQubits, lo + kChunk);
+                std::copy(baseCost.begin() + lo, baseCost.begin() + hi, cost.begin() + lo);
+                for(const auto& row : rows) {
+                    addScaledRow(cost, row.first, row.second, lo, hi);
+                }
+                chunkBest[c] = minCost(cost, lo, hi);
+            });
+            best = std::make_pair(INT_MAX, -1);
+            for(int c = chunks - 1; c >= 0; c--) {
+                if(chunkBest[c].first < best.first) {
+                    best = chunkBest[c];
+                }
+            }
+        } else {
+            // rows are consumed one at a time, which a lazy oracle requires
+            cost = baseCost;
+            for(int k = F.offsets[qubit]; k < F.offsets[qubit + 1]; k++) {
+                if(placed[F.targets[k]]) {
+                    addScaledRow(cost, allPairDistance[qubitMapping.getItem(F.targets[k])], F.weights[k], 0, logQubits);
+                }
+            }
+            best = minCost(cost, 0, logQubits);
+        }
+        // printf("assign %d->%d\n", qubit, best.second);
+        qubitMapping.setItem(qubit, best.second);
+        placed[qubit] = 1;
+        baseCost[best.second] = INT_MAX / 2;
+    }
+}
+
+// Routing front of the dependency DAG, kept up to date as gates execute:
+// the blocked gates whose dependencies are all done (in arrival order), the
+// one-step lookahead gates that only wait on a front gate, and per logical
+// qubit the front / lookahead gate using it. Dependencies from last use per
+// qubit mean each qubit is in at most one gate of either kind.
+class FrontLayer {
+private:
+    enum : char { kPending, kFront, kDone };
+
+    const std::vector<std::pair<int, int>>& gates;
+    const GateDag& dag;
+    std::vector<int> inDegree;
+    std::vector<char> state;
+    std::vector<int> order;
+    std::vector<int> arrival;
+    std::vector<int> ready;
+    size_t readyHead = 0;
+    int live = 0, nextArrival = 0;
+
+    void setFuture(int gate, int value) {
+        futureOf[gates[gate].first] = value;
+        futureOf[gates[gate].second] = value;
+    }
+
+    void clearFuture(int gate) {
+        for (int qubit : {gates[gate].first, gates[gate].second}) {
+            if (futureOf[qubit] == gate) {
+                futureOf[qubit] = -1;
+            }
+        }
+    }
+
+    void enter(int gate) {
+        state[gate] = kFront;
+        arrival[gate] = nextArrival++;
+        order.push_back(gate);
+        live++;
+        gateOf[gates[gate].first] = gate;
+        gateOf[gates[gate].second] = gate;
+        for (int v : dag.successors[gate]) {
+            if (inDegree[v] == 1) {
+                setFuture(v, v);
+            }
+        }
+    }
+
+    template <class Emit>
+    void execute(int gate, Emit& emit) {
+        if (state[gate] == kFront) {
+            live--;
+            for (int qubit : {gates[gate].first, gates[gate].second}) {
+                if (gateOf[qubit] == gate) {
+                    gateOf[qubit] = -1;
+                }
+            }
+        }
+        state[gate] = kDone;
+        emit(gate);
+
+        for (int v : dag.successors[gate]) {
+            inDegree[v]--;
+            if (inDegree[v] == 0) {
+                clearFuture(v);
+                ready.push_back(v);
+            } else if (inDegree[v] == 1) {
+                // becomes lookahead if the one dependency left is a front gate
+                for (int u : dag.predecessors[v]) {
+                    if (state[u] != kDone) {
+                        if (state[u] == kFront) {
+                            setFuture(v, v);
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // drop executed gates from order once they make up half of it
+    void compact() {
+        if (order.size() < 64 || (int)order.size() < 2 * live) {
+            return;
+        }
+        size_t kept = 0;
+        for (int gate : order) {
+            if (state[gate] == kFront) {
+                order[kept++] = gate;
+            }
+        }
+        order.resize(kept);
+    }
+
+public:
+    std::vector<int> gateOf;
+    std::vector<int> futureOf;
+
+    FrontLayer(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, int numQubits) : gates(gates), dag(dag), inDegree(dag.inDegree), state(gates.size(), kPending), arrival(gates.size(), -1), gateOf(numQubits, -1), futureOf(numQubits, -1) {
+        for (int idx = 0; idx < (int)gates.size(); idx++) {
+            if (inDegree[idx] == 0) {
+                ready.push_back(idx);
+            }
+        }
+    }
+
+    bool empty() const {
+        return live == 0;
+    }
+
+    int size() const {
+        return live;
+    }
+
+    template <class F>
+    void forEach(F fn) const {
+        for (int gate : order) {
+            if (state[gate] == kFront) {
+                fn(gate);
+            }
+        }
+    }
+
+    // execute every ready gate whose qubits are adjacent, in FIFO order; the rest join the front
+    template <class Adjacent, class Emit>
+    void advance(Adjacent adjacent, Emit emit) {
+        while (readyHead < ready.size()) {
+            int gate = ready[readyHead++];
+            if (adjacent(gate)) {
+                execute(gate, emit);
+            } else {
+                enter(gate);
+            }
+        }
+        ready.clear();
+        readyHead = 0;
+        compact();
+    }
+
+    // after logical qubits a and b were swapped only their front gates can have become executable
+    template <class Adjacent, class Emit>
+    void afterSwap(int a, int b, Adjacent adjacent, Emit emit) {
+        int first = gateOf[a], second = gateOf[b];
+        if (first == second) {
+            second = -1;
+        }
+        if (first != -1 && second != -1 && arrival[second] < arrival[first]) {
+            std::swap(first, second);
+        }
+        for (int gate : {first, second}) {
+            if (gate != -1 && adjacent(gate)) {
+                execute(gate, emit);
+            }
+        }
+        advance(adjacent, emit);
+    }
+};
+
+// Score contributions of candidate swaps in structure-of-arrays form. Each
+// term is one gate whose distance a swap may change, given by its physical
+// endpoints before and after the swap, so scoring never touches the mapping.
+struct SwapTerms {
+    Span<int> candidate;
+    Span<int> weight;
+    Span<int> beforeA, beforeB, afterA, afterB;
+    int count = 0;
+
+    // room for capacity terms from arena, valid until its next reset
+    void reset(ScratchArena& arena, int capacity) {
+        candidate = arena.alloc<int>(capacity);
+        weight = arena.alloc<int>(capacity);
+        beforeA = arena.alloc<int>(capacity);
+        beforeB = arena.alloc<int>(capacity);
+        afterA = arena.alloc<int>(capacity);
+        afterB = arena.alloc<int>(capacity);
+        count = 0;
+    }
+
+    void add(int c, int w, int a, int b, int a2, int b2) {
+        candidate[count] = c;
+        weight[count] = w;
+        beforeA[count] = a;
+        beforeB[count] = b;
+        afterA[count] = a2;
+        afterB[count] = b2;
+        count++;
+    }
+
+    int size() const {
+        return count;
+    }
+};
+
+// scores[c] += weight * (distance after - distance before) for the terms in
+// [first, last), read-only over a full table
+template <typename T>
+void scoreSwapTerms(const T* distances, size_t n, const SwapTerms& terms, int first, int last, Span<int> scores) {
+    const int* candidate = terms.candidate.data();
+    const int* weight = terms.weight.data();
+    const int* beforeA = terms.beforeA.data();
+    const int* beforeB = terms.beforeB.data();
+    const int* afterA = terms.afterA.data();
+    const int* afterB = terms.afterB.data();
+    int* out = scores.data();
+    for (int t = first; t < last; t++) {
+        int delta = (int)distances[afterA[t] * n + afterB[t]] - (int)distances[beforeA[t] * n + beforeB[t]];
+        out[candidate[t]] += weight[t] * delta;
+    }
+}
+
+void scoreSwapTerms(const DistanceOracle& allPairDistance, const SwapTerms& terms, int first, int last, Span<int> scores) {
+    if (const DistanceTable* table = allPairDistance.fullTable()) {
+        if (table->elementBytes() == 1) {
+            scoreSwapTerms(table->bytes(), table->size(), terms, first, last, scores);
+        } else {
+            scoreSwapTerms(reinterpret_cast<const uint16_t*>(table->bytes()), table->size(), terms, first, last, scores);
+        }
+        return;
+    }
+    for (int t = first; t < last; t++) {
+        int delta = allPairDistance[terms.afterA[t]][terms.afterB[t]] - allPairDistance[terms.beforeA[t]][terms.beforeB[t]];
+        scores[terms.candidate[t]] += terms.weight[t] * delta;
+    }
+}
+
+// change in the summed distance of the front gates, the weight-2 terms, in
+// [first, last)
+int frontSwapDelta(const DistanceOracle& allPairDistance, const SwapTerms& terms, int first, int last) {
+    int delta = 0;
+    for (int t = first; t < last; t++) {
+        if (terms.weight[t] == 2) {
+            delta += allPairDistance[terms.afterA[t]][terms.afterB[t]] - allPairDistance[terms.beforeA[t]][terms.beforeB[t]];
+        }
+    }
+    return delta;
+}
+
+// A contiguous range of candidates scored as one unit, with the best score in
+// it and how many of its candidates reach that score.
+struct ScoreChunk {
+    int first, last;
+    int bestScore, bestCount;
+};
+
+// Fronts with at least this many candidates are scored in parallel when a
+// pool is given; below it the fork-join costs more than the scoring.
+const int kParallelCandidates = 2048;
+
+// seed stream of layout refinement passes, apart from the trial streams
+const unsigned kRefineStream = 0x5eed;
+
+class OperationCollector : public OperationSink {
+private:
+    std::vector<std::pair<int, std::pair<int, int>>>& operations;
+
+public:
+    explicit OperationCollector(std::vector<std::pair<int, std::pair<int, int>>>& operations) : operations(operations) {}
+
+    void operation(int type, int a, int b) override {
+        operations.push_back(std::make_pair(type, std::make_pair(a, b)));
+    }
+};
+
+class OperationDiscard : public OperationSink {
+public:
+    void operation(int, int, int) override {}
+};
+
+std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, std::mt19937& rng) {
+    std::vector<std::pair<int, std::pair<int, int>>> operations;
+    OperationCollector collector(operations);
+    sabresSwap(gates, dag, g, allPairDistance, qubitMapping, rng, collector);
+    return operations;
+}
+
+// Route from the layout in qubitMapping, which holds the final layout afterwards,
+// passing each operation to sink. Ties between equally scored swaps are broken
+// with rng. Returns the number of SWAPs.
+//
+// With a pool, wide fronts are scored in chunks of candidates, each keeping its
+// own best score and tie list. Ties are merged in chunk order, so the tie list
+// and therefore the rng pick match the serial pass for any pool size. Only a
+// full distance table is shared across threads; a cached oracle is scored
+// serially.
+//
+// With a deadline the pass gives up once it has passed, returning -1 with
+// qubitMapping and sink left mid-route. With finishAtDeadline it instead
+// routes every remaining gate through the shortest-path fallback below, which
+// skips scoring, so the pass still completes shortly after the deadline.
+//
+// Progress is a gate executing or the summed distance of the front gates
+// falling below its lowest value since the front last changed. After
+// stallLimit heuristic SWAPs in a row without progress, the closest front gate
+// is routed along a shortest path and executed. No more than
+// stallLimit + diameter - 1 SWAPs come between two points of progress, and the
+// sum can only fall so often, so the heuristic cannot oscillate forever. A gate whose qubits sit in disconnected
+// parts of the device throws std::runtime_error once it reaches the fallback.
+int sabresSwap(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, std::mt19937& rng, OperationSink& sink, ThreadPool* pool, const Deadline* deadline, int stallLimit, bool finishAtDeadline) {
+    int swaps = 0;
+    FrontLayer layer(gates, dag, qubitMapping.size());
+
+    auto adjacent = [&](int gate) {
+        STATS_ADD(distanceLookups, 1);
+        return allPairDistance[qubitMapping.getItem(gates[gate].first)][qubitMapping.getItem(gates[gate].second)] == 1;
+    };
+    auto distance = [&](int gate) {
+        return allPairDistance[qubitMapping.getItem(gates[gate].first)][qubitMapping.getItem(gates[gate].second)];
+    };
+    int executed = 0;
+    auto emit = [&](int gate) {
+        sink.operation(1, gates[gate].first, gates[gate].second);
+        executed++;
+    };
+    auto applySwap = [&](std::pair<int, int> swap) {
+        swapQubit(qubitMapping, swap);
+        sink.operation(0, swap.first, swap.second);
+        swaps++;
+        layer.afterSwap(swap.first, swap.second, adjacent, emit);
+    };
+
+    // move the first qubit of the closest front gate towards the second one,
+    // one hop down the distance table at a time, until the gate executes
+    auto routeClosest = [&]() {
+        STATS_ADD(stallReleases, 1);
+        int closest = -1, closestDistance = INT_MAX;
+        layer.forEach([&](int gate) {
+            int d = distance(gate);
+            if (d < closestDistance) {
+                closest = gate;
+                closestDistance = d;
+            }
+        });
+        int logMain = gates[closest].first;
+        int target = qubitMapping.getItem(gates[closest].second);
+        for (int d = closestDistance; d > 1; d--) {
+            int phyMain = qubitMapping.getItem(logMain);
+            int hop = -1;
+            for (int phyNeighbor : g.getNeighbor(phyMain)) {
+                if (allPairDistance[phyNeighbor][target] == d - 1) {
+                    hop = phyNeighbor;
+                    break;
+                }
+            }
+            if (hop == -1) {
+                char message[96];
+                std::snprintf(message, sizeof(message), "no path between physical qubits %d and %d", phyMain + 1, target + 1);
+                throw std::runtime_error(message);
+            }
+            applySwap(std::make_pair(logMain, qubitMapping.getReverseItem(hop)));
+        }
+    };
+
+    // per-iteration containers live in the arena, sized from the front layer
+    ScratchArena arena;
+    SwapTerms terms;
+    std::pair<int, int> bestSwap;
+    bool parallel = pool && pool->size() > 1 && allPairDistance.fullTable();
+    int maxDegree = g.maxDegree();
+    // the previous SWAP, not to be undone straight away
+    std::pair<int, int> punishSwap = std::make_pair(-1, -1);
+    // summed front distance, its lowest value since the front last changed,
+    // and heuristic SWAPs since either a gate executed or that value fell
+    int lastExecuted = -1, stalled = 0;
+    int frontDistance = 0, bestFrontDistance = 0;
+    // the clock is read again once 256 more SWAPs are out; the fallback adds
+    // several at a time, so a multiple of 256 may never be hit exactly
+    int nextDeadlineCheck = 0;
+    bool expired = false;
+
+    layer.advance(adjacent, emit);
+    while (!layer.empty()) {
+        if (deadline && !expired && swaps >= nextDeadlineCheck) {
+            nextDeadlineCheck = swaps + 256;
+            expired = deadline->expired();
+            if (expired && !finishAtDeadline) {
+                return -1;
+            }
+        }
+        STATS_ADD(swapIterations, 1);
+        STATS_FRONT(layer.size());
+
+        if (executed != lastExecuted) {
+            lastExecuted = executed;
+            stalled = 0;
+            frontDistance = 0;
+            layer.forEach([&](int gate) {
+                frontDistance += distance(gate);
+            });
+            bestFrontDistance = frontDistance;
+        }
+        if (expired || stalled >= stallLimit) {
+            routeClosest();
+            punishSwap = std::make_pair(-1, -1);
+            continue;
+        }
+
+        // candidate swaps in enumeration order with their score terms; each
+        // front gate yields at most 2 * maxDegree candidates of 4 terms each
+        arena.reset();
+        int maxCandidates = 2 * layer.size() * maxDegree;
+        Span<std::pair<int, int>> candidateSwaps = arena.alloc<std::pair<int, int>>(maxCandidates);
+        // first score term of each candidate, terms being grouped by candidate
+        Span<int> termStart = arena.alloc<int>(maxCandidates + 1);
+        int candidateCount = 0;
+        terms.reset(arena, 4 * maxCandidates);
+
+        // swap logical mainGate.first with each logical qubit next to it
+        auto addCandidates = [&](int logMain, int logPartner) {
+            int phyMain = qubitMapping.getItem(logMain);
+            int phyPartner = qubitMapping.getItem(logPartner);
+            for (int phyNeighbor : g.getNeighbor(phyMain)) {
+                int neighbor = qubitMapping.getReverseItem(phyNeighbor);
+                auto swap = std::make_pair(logMain, neighbor);
+                if(punishSwap == swap || (punishSwap.second == swap.first && punishSwap.first == swap.second)) {
+                    continue;
+                }
+                int c = candidateCount++;
+                candidateSwaps[c] = swap;
+                termStart[c] = terms.size();
+                // physical position of a logical qubit once logMain and neighbor are exchanged
+                auto moved = [&](int logical) {
+                    return logical == logMain ? phyNeighbor : logical == neighbor ? phyMain : qubitMapping.getItem(logical);
+                };
+                auto addGate = [&](int gate, int weight) {
+                    int u = gates[gate].first, v = gates[gate].second;
+                    terms.add(c, weight, qubitMapping.getItem(u), qubitMapping.getItem(v), moved(u), moved(v));
+                };
+
+                terms.add(c, 2, phyMain, phyPartner, phyNeighbor, logPartner == neighbor ? phyMain : phyPartner);
+                if (layer.gateOf[neighbor] != -1) {
+                    addGate(layer.gateOf[neighbor], 2);
+                }
+                if (layer.futureOf[logMain] != -1) {
+                    addGate(layer.futureOf[logMain], 1);
+                }
+                if (layer.futureOf[neighbor] != -1) {
+                    addGate(layer.futureOf[neighbor], 1);
+                }
+            }
+        };
+        layer.forEach([&](int candidate) {
+            addCandidates(gates[candidate].first, gates[candidate].second);
+            addCandidates(gates[candidate].second, gates[candidate].first);
+        });
+
+        termStart[candidateCount] = terms.size();
+        if (candidateCount == 0) {
+            // every candidate would undo the previous SWAP
+            routeClosest();
+            punishSwap = std::make_pair(-1, -1);
+            continue;
+        }
+
+        // each chunk writes its own score slots and keeps its ties, in
+        // candidate order, in ties[first..]
+        int chunks = parallel && candidateCount >= kParallelCandidates ? pool->size() : 1;
+        Span<int> scores = arena.alloc<int>(candidateCount, 0);
+        Span<int> ties = arena.alloc<int>(candidateCount);
+        Span<ScoreChunk> parts = arena.alloc<ScoreChunk>(chunks);
+        auto scoreChunk = [&](int k) {
+            ScoreChunk& part = parts[k];
+            part.first = (long long)candidateCount * k / chunks;
+            part.last = (long long)candidateCount * (k + 1) / chunks;
+            part.bestScore = INT_MAX;
+            part.bestCount = 0;
+            scoreSwapTerms(allPairDistance, terms, termStart[part.first], termStart[part.last], scores);
+            for (int c = part.first; c < part.last; c++) {
+                if (scores[c] < part.bestScore) {
+                    part.bestScore = scores[c];
+                    part.bestCount = 0;
+                    ties[part.first + part.bestCount++] = c;
+                } else if (scores[c] == part.bestScore) {
+                    ties[part.first + part.bestCount++] = c;
+                }
+            }
+        };
+        if (chunks == 1) {
+            scoreChunk(0);
+        } else {
+            pool->parallelFor(chunks, scoreChunk);
+        }
+        STATS_ADD(candidatesEvaluated, candidateCount);
+        STATS_ADD(distanceLookups, 2 * terms.size());
+
+        int bestScore = INT_MAX;
+        for (const ScoreChunk& part : parts) {
+            bestScore = std::min(bestScore, part.bestScore);
+        }
+        int bestCount = 0;
+        for (const ScoreChunk& part : parts) {
+            if (part.bestScore == bestScore) {
+                for (int i = 0; i < part.bestCount; i++) {
+                    ties[bestCount++] = ties[part.first + i];
+                }
+            }
+        }
+
+        int idx = rng() % bestCount;
+        bestSwap = candidateSwaps[ties[idx]];
+        punishSwap = bestSwap;
+
+        // printf("best swap (%d, %d), score %d\n", bestSwap.first, bestSwap.second, bestScore);
+        applySwap(bestSwap);
+        frontDistance += frontSwapDelta(allPairDistance, terms, termStart[ties[idx]], termStart[ties[idx] + 1]);
+        if (frontDistance < bestFrontDistance) {
+            bestFrontDistance = frontDistance;
+            stalled = 0;
+        } else {
+            stalled++;
+        }
+    }
+
+    return swaps;
+}
+
+// Run independent routing passes from the same layout, each with its own
+// seeded RNG, mapping copy and distance oracle copy, and keep the one with
+// the fewest SWAPs (the lowest trial index on ties). Trial i is seeded from
+// (seed, i), so results depend on neither the pool size nor scheduling.
+RoutingResult routeTrials(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, const BiDict& initialMapping, int trials, unsigned seed, ThreadPool& pool, int stallLimit) {
+    std::vector<std::vector<std::pair<int, std::pair<int, int>>>> operations(trials);
+    std::vector<int> swaps(trials, 0);
+    std::vector<std::pair<size_t, size_t>> cacheCounters(trials);
+    // pool workers must not throw; the first trial's error is rethrown here
+    std::vector<std::exception_ptr> errors(trials);
+
+    pool.parallelFor(trials, [&](int trial) {
+        std::seed_seq seq{seed, (unsigned)trial};
+        std::mt19937 rng(seq);
+        BiDict qubitMapping = initialMapping;
+        DistanceOracle distances = allPairDistance;
+        OperationCollector collector(operations[trial]);
+        try {
+            swaps[trial] = sabresSwap(gates, dag, g, distances, qubitMapping, rng, collector, nullptr, nullptr, stallLimit);
+        } catch (...) {
+            errors[trial] = std::current_exception();
+        }
+        cacheCounters[trial] = std::make_pair(distances.hits(), distances.misses());
+    });
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    int best = std::min_element(swaps.begin(), swaps.end()) - swaps.begin();
+    RoutingResult result{initialMapping, std::move(operations[best]), swaps[best]};
+    for (const auto& counters : cacheCounters) {
+        result.distanceHits += counters.first;
+        result.distanceMisses += counters.second;
+    }
+    return result;
+}
+
+// SABRE's reverse traversal: route the circuit forward, then the reversed
+// circuit starting from the final layout, and take the layout it ends in as
+// the new initial layout.
+void refineLayout(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const GateDag& reversedDag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, int rounds, unsigned seed, ThreadPool* pool, int stallLimit) {
+    std::seed_seq seq{seed, kRefineStream};
+    std::mt19937 rng(seq);
+    OperationDiscard discard;
+    for (int round = 0; round < rounds; round++) {
+        sabresSwap(gates, dag, g, allPairDistance, qubitMapping, rng, discard, pool, nullptr, stallLimit);
+        sabresSwap(gates, reversedDag, g, allPairDistance, qubitMapping, rng, discard, pool, nullptr, stallLimit);
+    }
+}
+
+static double secondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+RoutingResult Router::route(const Circuit& circuit) {
+    std::vector<std::pair<int, std::pair<int, int>>> operations;
+    OperationCollector collector(operations);
+    RoutingResult result = route(circuit, collector);
+    result.operations = std::move(operations);
+    return result;
+}
+
+RoutingResult Router::route(const Circuit& circuit, OperationSink& sink) {
+    if (options.deadline > 0) {
+        return routeAnytime(circuit, sink);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int numGates = circuit.gates.size();
+    DistanceOracle allPairDistance = device.distances();
+
+    BiDict qubitMapping(circuit.logQubits);
+    for (int i = 0; i < circuit.logQubits; ++i) {
+        qubitMapping.setItem(i, i);
+    }
+    {
+        STATS_TIMER(kPlacement);
+        allocateQubit(circuit.gates, allPairDistance, device.graph(), qubitMapping, circuit.logQubits, &pool);
+    }
+    double placementSeconds = secondsBetween(start, std::chrono::steady_clock::now());
+
+    STATS_TIMER(kRouting);
+    GateDag dag(circuit.dependencies, numGates);
+    if (options.bidirRounds > 0) {
+        GateDag reversedDag(circuit.dependencies, numGates, true);
+        refineLayout(circuit.gates, dag, reversedDag, device.graph(), allPairDistance, qubitMapping, options.bidirRounds, options.seed, &pool, options.stallLimit);
+    }
+
+    if (options.trials == 1) {
+        // the same stream routeTrials gives trial 0
+        RoutingResult result;
+        result.initialMapping = qubitMapping;
+        result.placementSeconds = placementSeconds;
+        sink.layout(qubitMapping);
+        std::seed_seq seq{options.seed, 0u};
+        std::mt19937 rng(seq);
+        result.swaps = sabresSwap(circuit.gates, dag, device.graph(), allPairDistance, qubitMapping, rng, sink, &pool, nullptr, options.stallLimit);
+        result.distanceHits = allPairDistance.hits();
+        result.distanceMisses = allPairDistance.misses();
+        return result;
+    }
+
+    RoutingResult result = routeTrials(circuit.gates, dag, device.graph(), allPairDistance, qubitMapping, options.trials, options.seed, pool, options.stallLimit);
+    result.placementSeconds = placementSeconds;
+    result.distanceHits += allPairDistance.hits();
+    result.distanceMisses += allPairDistance.misses();
+    sink.layout(result.initialMapping);
+    for (const auto& op : result.operations) {
+        sink.operation(op.first, op.second.first, op.second.second);
+    }
+    result.operations.clear();
+    result.operations.shrink_to_fit();
+    return result;
+}
+
+RoutingResult Router::routeAnytime(const Circuit& circuit, OperationSink& sink) {
+    // start a pass only when this many times its expected length remains
+    const double kPassMargin = 1.25;
+    auto start = std::chrono::steady_clock::now();
+    Deadline deadline(options.deadline);
+    int numGates = circuit.gates.size();
+    DistanceOracle allPairDistance = device.distances();
+
+    BiDict qubitMapping(circuit.logQubits);
+    for (int i = 0; i < circuit.logQubits; ++i) {
+        qubitMapping.setItem(i, i);
+    }
+    {
+        STATS_TIMER(kPlacement);
+        allocateQubit(circuit.gates, allPairDistance, device.graph(), qubitMapping, circuit.logQubits, &pool);
+    }
+    auto placed = std::chrono::steady_clock::now();
+
+    STATS_TIMER(kRouting);
+    GateDag dag(circuit.dependencies, numGates);
+    GateDag reversedDag(circuit.dependencies, numGates, true);
+
+    // a complete routing first, the same one a plain single-trial route() gives
+    // unless the deadline cuts it short and the rest goes along shortest paths
+    RoutingResult best;
+    best.initialMapping = qubitMapping;
+    {
+        BiDict mapping = qubitMapping;
+        std::seed_seq seq{options.seed, 0u};
+        std::mt19937 rng(seq);
+        OperationCollector collector(best.operations);
+        best.swaps = sabresSwap(circuit.gates, dag, device.graph(), allPairDistance, mapping, rng, collector, &pool, &deadline, options.stallLimit, true);
+    }
+    auto firstDone = std::chrono::steady_clock::now();
+    best.firstPassSwaps = best.swaps;
+    double passSeconds = secondsBetween(placed, firstDone);
+
+    // even passes refine the best layout with one backward and forward pass
+    // and route from the result, odd passes (and even ones a refinement would
+    // not fit in) route the best layout with the next trial seed
+    std::vector<std::pair<int, std::pair<int, int>>> operations;
+    OperationDiscard discard;
+    unsigned trial = 1;
+    for (int pass = 0; ; pass++) {
+        bool refine = pass % 2 == 0 && deadline.remaining() >= kPassMargin * 3 * passSeconds;
+        int cost = refine ? 3 : 1;
+        if (deadline.remaining() < kPassMargin * cost * passSeconds) {
+            break;
+        }
+        auto passStart = std::chrono::steady_clock::now();
+        BiDict layout = best.initialMapping;
+        if (refine) {
+            std::seed_seq seq{options.seed, kRefineStream, (unsigned)pass};
+            std::mt19937 rng(seq);
+            BiDict mapping = layout;
+            if (sabresSwap(circuit.gates, dag, device.graph(), allPairDistance, mapping, rng, discard, &pool, &deadline, options.stallLimit) < 0 || sabresSwap(circuit.gates, reversedDag, device.graph(), allPairDistance, mapping, rng, discard, &pool, &deadline, options.stallLimit) < 0) {
+                break;
+            }
+            layout = mapping;
+        }
+        std::seed_seq seq{options.seed, refine ? 0u : trial++};
+        std::mt19937 rng(seq);
+        BiDict mapping = layout;
+        operations.clear();
+        OperationCollector collector(operations);
+        int swaps = sabresSwap(circuit.gates, dag, device.graph(), allPairDistance, mapping, rng, collector, &pool, &deadline, options.stallLimit);
+        if (swaps < 0) {
+            break;
+        }
+        best.improvementPasses++;
+        if (swaps < best.swaps) {
+            best.initialMapping = layout;
+            best.operations.swap(operations);
+            best.swaps = swaps;
+            best.improvements++;
+        }
+        passSeconds = std::max(passSeconds, secondsBetween(passStart, std::chrono::steady_clock::now()) / cost);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    best.placementSeconds = secondsBetween(start, placed);
+    best.firstPassSeconds = secondsBetween(placed, firstDone);
+    best.improveSeconds = secondsBetween(firstDone, end);
+    best.distanceHits = allPairDistance.hits();
+    best.distanceMisses = allPairDistance.misses();
+    sink.layout(best.initialMapping);
+    for (const auto& op : best.operations) {
+        sink.operation(op.first, op.second.first, op.second.second);
+    }
+    best.operations.clear();
+    best.operations.shrink_to_fit();
+    return best;
+}
+
+RoutingResult Router::routeWindowed(int logQubits, const std::function<int(std::vector<std::pair<int, int>>&, int)>& readGates, OperationSink& sink) {
+    int window = std::max(1, options.window);
+    Deadline deadline(options.deadline);
+    DistanceOracle allPairDistance = device.distances();
+    std::vector<std::pair<int, int>> gates;
+    std::vector<std::pair<int, int>> dependencies;
+    std::vector<int> lastUse(logQubits);
+    gates.reserve(window);
+
+    BiDict qubitMapping(logQubits);
+    for (int i = 0; i < logQubits; ++i) {
+        qubitMapping.setItem(i, i);
+    }
+    std::seed_seq seq{options.seed, 0u};
+    std::mt19937 rng(seq);
+    RoutingResult result;
+    result.initialMapping = qubitMapping;
+
+    for (bool first = true; ; first = false) {
+        gates.clear();
+        int count = readGates(gates, window);
+        if (first) {
+            STATS_TIMER(kPlacement);
+            allocateQubit(gates, allPairDistance, device.graph(), qubitMapping, logQubits, &pool);
+            result.initialMapping = qubitMapping;
+            sink.layout(qubitMapping);
+        }
+        if (count == 0) {
+            break;
+        }
+
+        // earlier windows are fully executed, so only dependencies inside this one remain
+        dependencies.clear();
+        std::fill(lastUse.begin(), lastUse.end(), -1);
+        for (int idx = 0; idx < count; idx++) {
+            int a = gates[idx].first, b = gates[idx].second;
+            if (lastUse[a] != -1) {
+                dependencies.push_back(std::make_pair(lastUse[a], idx));
+            }
+            if (lastUse[b] != -1 && lastUse[b] != lastUse[a]) {
+                dependencies.push_back(std::make_pair(lastUse[b], idx));
+            }
+            lastUse[a] = lastUse[b] = idx;
+        }
+        STATS_TIMER(kRouting);
+        GateDag dag(dependencies, count);
+        result.swaps += sabresSwap(gates, dag, device.graph(), allPairDistance, qubitMapping, rng, sink, &pool, options.deadline > 0 ? &deadline : nullptr, options.stallLimit, true);
+        if (count < window) {
+            break;
+        }
+    }
+
+    result.distanceHits = allPairDistance.hits();
+    result.distanceMisses = allPairDistance.misses();
+    return result;
+}
+
+std::shared_ptr<const Device> DevicePool::get(Graph graph, bool* built) {
+    std::vector<uint32_t> key = DistanceCache::graphKey(FlatAdjacency(graph));
+    std::promise<std::shared_ptr<const Device>> promise;
+    std::shared_future<std::shared_ptr<const Device>> device;
+    bool owner = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = devices.find(key);
+        if (it == devices.end()) {
+            device = promise.get_future().share();
+            devices.emplace(key, device);
+            owner = true;
+        } else {
+            device = it->second;
+        }
+    }
+    if (owner) {
+        try {
+            promise.set_value(std::make_shared<const Device>(std::move(graph), options));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(mutex);
+            devices.erase(key);
+        }
+    }
+    if (built) {
+        *built = owner;
+    }
+    return device.get();
+}
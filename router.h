@@ -0,0 +1,288 @@
+#pragma once
+
+#include <climits>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "csr_adjacency.h"
+#include "distance_oracle.h"
+#include "thread_pool.h"
+
+class BiDict {
+private:
+    std::vector<int> forward;
+    std::vector<int> reverse;
+
+public:
+    BiDict(int size = 0) : forward(size), reverse(size) {}
+
+    void setItem(int key, int value) {
+        forward[key] = value;
+        reverse[value] = key;
+    }
+
+    int getItem(int key) const {
+        return forward[key];
+    }
+
+    int getReverseItem(int key) const {
+        return reverse[key];
+    }
+
+    int size() const {
+        return forward.size();
+    }
+
+    friend void swapQubit(BiDict& qubitMapping, std::pair<int, int> gate);
+};
+
+void swapQubit(BiDict& qubitMapping, std::pair<int, int> gate);
+
+// Undirected coupling graph in CSR form, built once from the link list.
+class Graph {
+private:
+    CsrAdjacency graph;
+
+public:
+    Graph() = default;
+    Graph(int n, const std::vector<std::pair<int, int>>& links) : graph(n, links, CsrAdjacency::kBoth) {}
+    explicit Graph(CsrAdjacency adjacency) : graph(std::move(adjacency)) {}
+
+    std::vector<int> getInDegree() const {
+        std::vector<int> inDegree(size());
+        for (int i = 0; i < size(); i++) {
+            inDegree[i] = graph.degree(i);
+        }
+        return inDegree;
+    }
+
+    int maxInDegree() const {
+        int maxInDegree = INT_MIN;
+        int maxInDegreeIdx = -1;
+        for(int i=0; i< size(); i++) {
+            if(graph.degree(i) > maxInDegree) {
+                maxInDegree = graph.degree(i);
+                maxInDegreeIdx = i;
+            }
+        }
+        assert(maxInDegreeIdx != -1);
+        return maxInDegreeIdx;
+    }
+
+    int maxDegree() const {
+        return graph.maxDegree();
+    }
+
+    Span<const int> getNeighbor(int node) const {
+        return graph[node];
+    }
+
+    int size() const {
+        return graph.size();
+    }
+
+    DistanceTable allPairDistances() const {
+        return DistanceTable(*this);
+    }
+
+};
+
+// gate dependencies as successor lists plus the initial in-degrees, built once and shared by every routing pass.
+// The reversed DAG runs the circuit back to front for layout refinement.
+struct GateDag {
+    CsrAdjacency successors;
+    CsrAdjacency predecessors;
+    std::vector<int> inDegree;
+
+    GateDag(const std::vector<std::pair<int, int>>& dependencies, int numGates, bool reversed = false)
+        : successors(numGates, dependencies, reversed ? CsrAdjacency::kBackward : CsrAdjacency::kForward),
+          predecessors(numGates, dependencies, reversed ? CsrAdjacency::kForward : CsrAdjacency::kBackward),
+          inDegree(numGates, 0) {
+        for (const auto& dependency : dependencies) {
+            inDegree[reversed ? dependency.first : dependency.second]++;
+        }
+    }
+};
+
+struct RoutingResult {
+    BiDict initialMapping;
+    std::vector<std::pair<int, std::pair<int, int>>> operations;
+    int swaps = 0;
+    // lazy distance cache counters summed over all trials
+    size_t distanceHits = 0, distanceMisses = 0;
+    // seconds spent on placement; deadline-aware routing also fills in the
+    // pass timings, improvement passes run and how many beat the best so far
+    double placementSeconds = 0, firstPassSeconds = 0, improveSeconds = 0;
+    int firstPassSwaps = 0;
+    int improvementPasses = 0, improvements = 0;
+};
+
+// A point in wall-clock time that routing must not run past.
+class Deadline {
+private:
+    std::chrono::steady_clock::time_point end;
+
+public:
+    explicit Deadline(double seconds) : end(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds))) {}
+
+    bool expired() const {
+        return std::chrono::steady_clock::now() >= end;
+    }
+
+    double remaining() const {
+        return std::chrono::duration<double>(end - std::chrono::steady_clock::now()).count();
+    }
+};
+
+// Receives a routed circuit as it is produced: the initial layout once, then
+// every operation in order, type 1 for a CNOT and 0 for a SWAP on logical qubits.
+class OperationSink {
+public:
+    virtual ~OperationSink() = default;
+    virtual void layout(const BiDict& /*initialMapping*/) {}
+    virtual void operation(int type, int a, int b) = 0;
+};
+
+// Routing stages, composed by Router::route
+void allocateQubit(const std::vector<std::pair<int, int>>& gates, const DistanceOracle& allPairDistance, const Graph& g, BiDict& qubitMapping, int logQubits, ThreadPool* pool);
+std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, std::mt19937& rng);
+// SWAPs without progress (a gate executing or the summed front distance reaching a new low) that sabresSwap allows before it routes a gate along a shortest path
+const int kDefaultStallLimit = 64;
+
+int sabresSwap(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, std::mt19937& rng, OperationSink& sink, ThreadPool* pool = nullptr, const Deadline* deadline = nullptr, int stallLimit = kDefaultStallLimit, bool finishAtDeadline = false);
+RoutingResult routeTrials(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const Graph& g, const DistanceOracle& allPairDistance, const BiDict& initialMapping, int trials, unsigned seed, ThreadPool& pool, int stallLimit = kDefaultStallLimit);
+void refineLayout(const std::vector<std::pair<int, int>>& gates, const GateDag& dag, const GateDag& reversedDag, const Graph& g, const DistanceOracle& allPairDistance, BiDict& qubitMapping, int rounds, unsigned seed, ThreadPool* pool = nullptr, int stallLimit = kDefaultStallLimit);
+
+struct Circuit {
+    int logQubits = 0;
+    std::vector<std::pair<int, int>> gates;
+    std::vector<std::pair<int, int>> dependencies;
+};
+
+struct DeviceOptions {
+    // bytes the distance data may occupy, 0 keeps the full table
+    size_t distBudget = 0;
+    // directory of the on-disk distance cache, empty to disable
+    std::string distCache;
+};
+
+// A coupling graph with its distance data, built once. Devices are
+// immutable, so one instance can back any number of Routers on any threads.
+class Device {
+private:
+    Graph coupling;
+    DistanceOracle distanceOracle;
+
+public:
+    explicit Device(Graph graph, const DeviceOptions& options = DeviceOptions()) : coupling(std::move(graph)) {
+        distanceOracle = DistanceOracle::build(coupling, options.distBudget, options.distCache);
+    }
+
+    const Graph& graph() const {
+        return coupling;
+    }
+
+    // A new handle on the distance data, built in the constructor. The full
+    // table is shared between handles; a lazy oracle's row cache belongs to
+    // the handle, so the Device itself is never written after construction.
+    DistanceOracle distances() const {
+        return distanceOracle;
+    }
+
+    int size() const {
+        return coupling.size();
+    }
+};
+
+// Devices keyed by coupling graph (DistanceCache::graphKey), so circuits
+// that target the same device share one Device and its distance data. Safe
+// to use from many threads; a device requested while another thread builds
+// it waits for it. If the build throws, the builder and every waiter get that
+// exception and the pool forgets the graph, so a later request tries again.
+class DevicePool {
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t>& key) const {
+            return DistanceCache::graphHash(key);
+        }
+    };
+
+    DeviceOptions options;
+    std::mutex mutex;
+    // whole keys are compared on lookup, so graphs whose hashes collide stay apart
+    std::unordered_map<std::vector<uint32_t>, std::shared_future<std::shared_ptr<const Device>>, KeyHash> devices;
+
+public:
+    explicit DevicePool(const DeviceOptions& options = DeviceOptions()) : options(options) {}
+
+    // the shared device for this coupling graph; built is set when this call created it
+    std::shared_ptr<const Device> get(Graph graph, bool* built = nullptr);
+};
+
+struct RouterOptions {
+    int trials = 1;
+    int bidirRounds = 0;
+    unsigned seed = 42;
+    // threads <= 0 uses every hardware thread
+    int threads = 0;
+    // gates per window for routeWindowed
+    int window = 1 << 16;
+    // seconds route() may spend; 0 disables deadline-aware routing
+    double deadline = 0;
+    // SWAPs without progress before a gate is routed along a shortest path
+    int stallLimit = kDefaultStallLimit;
+};
+
+// Routes circuits onto a Device: placement, optional layout refinement and
+// the best of options.trials SABRE passes. A Router owns its thread pool, so
+// route() calls on one Router must not overlap; use one Router per thread.
+class Router {
+private:
+    const Device& device;
+    RouterOptions options;
+    ThreadPool pool;
+
+    RoutingResult routeAnytime(const Circuit& circuit, OperationSink& sink);
+
+public:
+    Router(const Device& device, const RouterOptions& options) : device(device), options(options), pool(options.threads) {}
+
+    RoutingResult route(const Circuit& circuit);
+
+    // Streams the layout and operations into sink instead of collecting them;
+    // the returned result has no operations. With a single trial nothing is
+    // buffered, with several the best trial is replayed once it is known.
+    // Throws std::runtime_error if a gate's qubits cannot be connected.
+    //
+    // With options.deadline set, trials and bidirRounds are ignored. After
+    // placement, which always runs to completion, the router makes one greedy
+    // pass; if the deadline passes during it, the remaining gates are routed
+    // along shortest paths, so a complete routing exists shortly after the
+    // deadline at the latest. Any budget left goes to improvement passes:
+    // refinement rounds over the best layout, alternating with fresh seeds. A
+    // pass starts only if it is expected to fit, and is abandoned at the
+    // deadline. The best complete routing is then replayed into sink. How far
+    // it gets depends on machine speed, so this mode is not reproducible
+    // across runs.
+    RoutingResult route(const Circuit& circuit, OperationSink& sink);
+
+    // Routes a circuit whose gates arrive from readGates(gates, maxCount),
+    // which appends up to maxCount gates and returns how many it appended.
+    // Gates are routed options.window at a time with dependencies derived from
+    // last use per qubit, and every window is finished before the next one
+    // is read, so memory depends on window and not on circuit length. The
+    // layout is placed from the first window; trials and bidirRounds do not
+    // apply. With options.deadline set, gates still unrouted at the deadline
+    // are routed along shortest paths.
+    RoutingResult routeWindowed(int logQubits, const std::function<int(std::vector<std::pair<int, int>>&, int)>& readGates, OperationSink& sink);
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "router.h"
+
+// Command line flags for DeviceOptions and RouterOptions, shared by
+// sabre_swap and sabre_bench so both route with the same settings.
+const char* const kRouterFlagsUsage = "[--dist-budget MiB] [--dist-cache DIR] [--threads N] [--trials N] [--bidir N] [--seed S] [--stall-limit N]";
+
+// consumes argv[i] and its value when it is one of the flags above
+inline bool parseRouterFlag(int argc, char** argv, int& i, DeviceOptions& deviceOptions, RouterOptions& routerOptions) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    if (std::strcmp(argv[i], "--dist-budget") == 0) {
+        // MiB the distance data may occupy, 0 keeps the full table
+        deviceOptions.distBudget = std::strtoull(argv[++i], nullptr, 10) << 20;
+    } else if (std::strcmp(argv[i], "--dist-cache") == 0) {
+        deviceOptions.distCache = argv[++i];
+    } else if (std::strcmp(argv[i], "--threads") == 0) {
+        routerOptions.threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--trials") == 0) {
+        routerOptions.trials = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--bidir") == 0) {
+        // forward-backward refinement rounds before the final forward pass
+        routerOptions.bidirRounds = std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--seed") == 0) {
+        routerOptions.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--stall-limit") == 0) {
+        // SWAPs without progress before a gate is routed along a shortest path
+        routerOptions.stallLimit = std::max(1, std::atoi(argv[++i]));
+    } else {
+        return false;
+    }
+    return true;
+}
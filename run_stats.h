@@ -0,0 +1,170 @@
+#pragma once
+
+// Counters and timers for the routers' hot loops, compiled in only when
+// ROUTER_STATS is defined (cmake -DROUTER_STATS=ON). Without it the STATS_*
+// macros expand to nothing. Each thread counts into its own block, and
+// STATS_REPORT sums them into one JSON object on the given FILE*.
+
+#ifdef ROUTER_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <sys/resource.h>
+
+struct RunStats {
+    // kOutput times formatting and writing a finished result; when output is
+    // streamed during routing that work falls under kRouting, and kFlush
+    // times only the final flush
+    enum Timer { kParse, kDistances, kPlacement, kRouting, kOutput, kFlush, kTimers };
+    // bucket b counts sizes in [2^(b-1), 2^b), bucket 0 counts empty fronts
+    static constexpr int kBuckets = 32;
+
+    uint64_t swapIterations = 0;
+    uint64_t candidatesEvaluated = 0;
+    uint64_t nearestQubitCalls = 0;
+    uint64_t nearestQubitNodes = 0;
+    uint64_t pqPops = 0;
+    uint64_t pqRepushes = 0;
+    uint64_t distanceLookups = 0;
+    uint64_t stallReleases = 0;
+    uint64_t frontSize[kBuckets] = {};
+    uint64_t timerNs[kTimers] = {};
+
+    void addFront(size_t size) {
+        int bucket = size == 0 ? 0 : 64 - __builtin_clzll(size);
+        frontSize[std::min(bucket, kBuckets - 1)]++;
+    }
+
+    void merge(const RunStats& other) {
+        swapIterations += other.swapIterations;
+        candidatesEvaluated += other.candidatesEvaluated;
+        nearestQubitCalls += other.nearestQubitCalls;
+        nearestQubitNodes += other.nearestQubitNodes;
+        pqPops += other.pqPops;
+        pqRepushes += other.pqRepushes;
+        distanceLookups += other.distanceLookups;
+        stallReleases += other.stallReleases;
+        for (int b = 0; b < kBuckets; b++) {
+            frontSize[b] += other.frontSize[b];
+        }
+        for (int t = 0; t < kTimers; t++) {
+            timerNs[t] += other.timerNs[t];
+        }
+    }
+
+    static RunStats& local();
+    static void report(FILE* out);
+};
+
+// live per-thread blocks plus everything counted by threads that have exited
+class StatsRegistry {
+private:
+    std::mutex mutex;
+    std::vector<const RunStats*> live;
+    RunStats retired;
+
+public:
+    static StatsRegistry& get() {
+        static StatsRegistry registry;
+        return registry;
+    }
+
+    void attach(const RunStats* stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        live.push_back(stats);
+    }
+
+    void detach(const RunStats* stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retired.merge(*stats);
+        live.erase(std::find(live.begin(), live.end(), stats));
+    }
+
+    RunStats total() {
+        std::lock_guard<std::mutex> lock(mutex);
+        RunStats sum = retired;
+        for (const RunStats* stats : live) {
+            sum.merge(*stats);
+        }
+        return sum;
+    }
+};
+
+struct ThreadStats {
+    RunStats stats;
+
+    ThreadStats() {
+        StatsRegistry::get().attach(&stats);
+    }
+
+    ~ThreadStats() {
+        StatsRegistry::get().detach(&stats);
+    }
+};
+
+inline RunStats& RunStats::local() {
+    thread_local ThreadStats block;
+    return block.stats;
+}
+
+// call while other threads are idle; live blocks are read without their owners' cooperation
+inline void RunStats::report(FILE* out) {
+    static const char* const kTimerNames[kTimers] = {"parse", "distances", "placement", "routing", "output", "flush"};
+    RunStats sum = StatsRegistry::get().total();
+    struct rusage usage;
+    long maxRssKiB = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+
+    std::fprintf(out, "{\"stats\": {\"swapIterations\": %llu, \"candidatesEvaluated\": %llu, \"nearestQubitCalls\": %llu, \"nearestQubitNodes\": %llu, \"pqPops\": %llu, \"pqRepushes\": %llu, \"distanceLookups\": %llu, \"stallReleases\": %llu, \"maxRssKiB\": %ld",
+                 (unsigned long long)sum.swapIterations, (unsigned long long)sum.candidatesEvaluated, (unsigned long long)sum.nearestQubitCalls, (unsigned long long)sum.nearestQubitNodes,
+                 (unsigned long long)sum.pqPops, (unsigned long long)sum.pqRepushes, (unsigned long long)sum.distanceLookups, (unsigned long long)sum.stallReleases, maxRssKiB);
+    std::fprintf(out, ", \"frontSizeHistogram\": {");
+    bool first = true;
+    for (int b = 0; b < kBuckets; b++) {
+        if (sum.frontSize[b] == 0) {
+            continue;
+        }
+        unsigned long long lo = b == 0 ? 0 : 1ull << (b - 1);
+        unsigned long long hi = b == 0 ? 0 : (1ull << b) - 1;
+        std::fprintf(out, "%s\"%llu-%llu\": %llu", first ? "" : ", ", lo, hi, (unsigned long long)sum.frontSize[b]);
+        first = false;
+    }
+    std::fprintf(out, "}, \"timersMs\": {");
+    for (int t = 0; t < kTimers; t++) {
+        std::fprintf(out, "%s\"%s\": %.3f", t ? ", " : "", kTimerNames[t], sum.timerNs[t] / 1e6);
+    }
+    std::fprintf(out, "}}}\n");
+}
+
+class StatsTimer {
+private:
+    RunStats::Timer timer;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StatsTimer(RunStats::Timer timer) : timer(timer), start(std::chrono::steady_clock::now()) {}
+
+    ~StatsTimer() {
+        RunStats::local().timerNs[timer] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_ADD(counter, n) (RunStats::local().counter += (n))
+#define STATS_FRONT(size) RunStats::local().addFront(size)
+#define STATS_TIMER(timer) StatsTimer STATS_CONCAT(statsTimer, __LINE__)(RunStats::timer)
+#define STATS_REPORT(out) RunStats::report(out)
+
+#else
+
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_FRONT(size) ((void)0)
+#define STATS_TIMER(timer) ((void)0)
+#define STATS_REPORT(out) ((void)0)
+
+#endif
@@ -1,511 +1,330 @@
-#include <iostream>
-#include <unordered_map>
-#include <unordered_set>
-#include <vector>
-#include <queue>
-#include <climits>
-#include <cmath>
-#include <cassert>
-#include <limits>
-#include <cstdlib>
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <exception>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "fast_input.h"
+#include "output_writer.h"
+#include "router.h"
+#include "router_flags.h"
+#include "run_stats.h"
 
-struct pairHash {
-    template <class T1, class T2>
-    std::size_t operator () (const std::pair<T1,T2> &p) const {
-        auto h1 = std::hash<T1>{}(p.first);
-        auto h2 = std::hash<T2>{}(p.second); 
-
-        return h1 * 31 ^ h2;
-    }
-};
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-class BiDict {
+// writes the routed circuit while the router produces it
+class WriterSink : public OperationSink {
 private:
-    std::vector<int> forward;
-    std::vector<int> reverse;
+    OutputWriter& out;
 
 public:
-    BiDict(int size) : forward(size), reverse(size) {}
-
-    void setItem(int key, int value) {
-        forward[key] = value;
-        reverse[value] = key;
-    }
-
-    int getItem(int key) {
-        return forward[key];
-    }
+    explicit WriterSink(OutputWriter& out) : out(out) {}
 
-    int getReverseItem(int key) {
-        return reverse[key];
+    void layout(const BiDict& initialMapping) override {
+        out.begin(initialMapping.size());
+        for (int i = 0; i < initialMapping.size(); ++i) {
+            out.mapping(i, initialMapping.getItem(i));
+        }
     }
 
-    int size() {
-        return forward.size();
+    void operation(int type, int a, int b) override {
+        if (type == 1) {
+            out.cnot(a, b);
+        } else {
+            out.swap(a, b);
+        }
     }
-
-    friend void swapQubit(BiDict& qubitMapping, std::pair<int, int> gate);
 };
 
-class Graph {
-private:
-    std::vector<std::vector<int>> graph;
-    std::vector<int> inDegree;
-
-public:
-    Graph() = default;
-    Graph(int n) : graph(n), inDegree(n, 0) {}
-
-    void addEdge(int node1, int node2) {
-        graph[node1].push_back(node2);
-        graph[node2].push_back(node1);
-        inDegree[node1]++;
-        inDegree[node2]++;
-    }
+struct BatchEntry {
+    std::string input;
+    std::string output;
+    bool ok = false;
+    bool sharedDevice = false;
+    std::string error;
+    int cnots = 0;
+    int swaps = 0;
+    // operations are written as they are routed, so routeMs includes
+    // formatting them; flushMs is only the final flush
+    double parseMs = 0, deviceMs = 0, routeMs = 0, flushMs = 0;
+};
 
-    std::vector<int> getInDegree() const {
-        return inDegree;
-    }
+// command line settings outside DeviceOptions and RouterOptions
+struct RunOptions {
+    // batch mode output directory
+    std::string outDir = "batch_out";
+    int threads = 0;
+    bool windowed = false;
+    bool binary = false;
+    double deadlineMs = 0;
+};
 
-    int maxInDegree() const {
-        int maxInDegree = INT_MIN;
-        int maxInDegreeIdx = -1;
-        for(int i=0; i< inDegree.size(); i++) {
-            if(inDegree[i] > maxInDegree) {
-                maxInDegree = inDegree[i];
-                maxInDegreeIdx = i;
+// share of a --deadline budget held back for writing the result
+const double kOutputShare = 0.1;
+
+// Routes every input on a work-stealing pool, one file per task. Files whose
+// coupling graphs match share a single Device from the pool.
+static int runBatch(const std::vector<std::string>& inputs, const RunOptions& options, const DeviceOptions& deviceOptions, RouterOptions routerOptions) {
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        std::error_code error;
+        if (std::filesystem::is_directory(input, error)) {
+            std::vector<std::string> listed;
+            for (const auto& entry : std::filesystem::directory_iterator(input)) {
+                if (entry.is_regular_file()) {
+                    listed.push_back(entry.path().string());
+                }
             }
+            std::sort(listed.begin(), listed.end());
+            files.insert(files.end(), listed.begin(), listed.end());
+        } else {
+            files.push_back(input);
         }
-        assert(maxInDegreeIdx != -1);
-        return maxInDegreeIdx;
     }
 
-    const auto& getNeighbor(int node) const {
-        return graph[node];
+    std::error_code error;
+    std::filesystem::create_directories(options.outDir, error);
+    if (error) {
+        std::fprintf(stderr, "cannot create %s\n", options.outDir.c_str());
+        return 1;
     }
 
-    std::vector<std::vector<int>> allPairDistances() const {
-        int n = graph.size();
-        std::vector<std::vector<int>> distances(n, std::vector<int>(n, -1));
-
-        for (int i = 0; i < n; i++) {
-            distances[i][i] = 0;
-            std::queue<int> q;
-            q.push(i);
-            std::vector<bool> visited(n, false);
-            visited[i] = true;
-            int distance = 0;
-
-            while (!q.empty()) {
-                int size = q.size();
-                for (int j = 0; j < size; j++) {
-                    int node = q.front();
-                    q.pop();
-                    for (int neighbor : getNeighbor(node)) {
-                        if (!visited[neighbor]) {
-                            visited[neighbor] = true;
-                            distances[i][neighbor] = distance + 1;
-                            q.push(neighbor);
-                        }
-                    }
-                }
-                distance++;
-            }
+    std::vector<BatchEntry> entries(files.size());
+    std::map<std::string, std::string> inputOf;
+    for (size_t i = 0; i < files.size(); i++) {
+        std::filesystem::path path(files[i]);
+        std::string name = path.filename().string();
+        // inputs from different directories may share a name
+        if (path.has_parent_path()) {
+            name = path.parent_path().filename().string() + "_" + name;
         }
-
-        return distances;
-    }
-
-};
-
-class dependencyGraph {
-private:
-    std::vector<std::vector<int>> graph;
-    std::vector<int> inDegree;
-    // std::vector<int> outDegree;
-public:
-    dependencyGraph(int n) : graph(n), inDegree(n, 0) {}
-
-    void build(const std::vector<std::pair<int, int>>& dependencies) {
-        for(const auto& dependency : dependencies) {
-            graph[dependency.first].push_back(dependency.second);
-            inDegree[dependency.second]++;
-            // outDegree[dependency.first]++;
+        entries[i].input = files[i];
+        entries[i].output = (std::filesystem::path(options.outDir) / (name + (options.binary ? ".bin" : ".out"))).string();
+        auto inserted = inputOf.emplace(entries[i].output, files[i]);
+        if (!inserted.second) {
+            std::fprintf(stderr, "%s and %s would both be written to %s\n", inserted.first->second.c_str(), files[i].c_str(), entries[i].output.c_str());
+            return 1;
         }
     }
 
-    void removeItem(int gateId) {
-        for(const auto& v : graph[gateId]) {
-            inDegree[v]--;
-            if(inDegree[v] == 0) {
-
+    // files are the unit of parallelism, each router stays single threaded
+    routerOptions.threads = 1;
+    DevicePool devices(deviceOptions);
+    WorkStealingPool pool(options.threads);
+    auto batchStart = std::chrono::steady_clock::now();
+    pool.run(entries.size(), [&](int task) {
+        BatchEntry& entry = entries[task];
+        auto start = std::chrono::steady_clock::now();
+        InputBuffer input;
+        CircuitHeader header;
+        Circuit circuit;
+        Graph g;
+        if (!input.open(entry.input)) {
+            return;
+        }
+        CircuitStream stream(input);
+        {
+            STATS_TIMER(kParse);
+            if (options.windowed ? !stream.open(header, g) : !readCircuit(input, header, circuit.gates, circuit.dependencies, g)) {
+                return;
             }
         }
-    }
-
-};
-
-void swapQubit(BiDict& qubitMapping, std::pair<int, int> gate) {
-    std::swap(qubitMapping.forward[gate.first], qubitMapping.forward[gate.second]);
-    std::swap(qubitMapping.reverse[qubitMapping.forward[gate.first]], qubitMapping.reverse[qubitMapping.forward[gate.second]]);
-}
-
-// Function declarations
-std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<std::pair<int, int>>& gates, const std::vector<std::pair<int, int>>& dependencies, const Graph& g, BiDict& qubitMapping, int logQubits, int numGates);
-
-int main() {
-    std::srand(42);
-    int logQubits, numGates, numDependencies, phyQubits, numPhyLinks;
-    std::cin >> logQubits >> numGates >> numDependencies >> phyQubits >> numPhyLinks;
-
-    std::vector<std::pair<int, int>> gates(numGates);
-    for (int i = 0; i < numGates; ++i) {
-        int _, srcbit, dstbit;
-        std::cin >> _ >> srcbit >> dstbit;
-        gates[i] = std::make_pair(srcbit - 1, dstbit - 1);
-    }
-
-    std::vector<std::pair<int, int>> dependencies(numDependencies);
-    for (int i = 0; i < numDependencies; ++i) {
-        int _, srcgate, tgtgate;
-        std::cin >> _ >> srcgate >> tgtgate;
-        dependencies[i] = std::make_pair(srcgate - 1, tgtgate - 1);
-    }
-
-    Graph g(logQubits);
-    for (int i = 0; i < numPhyLinks; ++i) {
-        int _, src, dst;
-        std::cin >> _ >> src >> dst;
-        g.addEdge(src - 1, dst - 1);
-    }
+        circuit.logQubits = header.logQubits;
+        entry.parseMs = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        bool built = false;
+        std::shared_ptr<const Device> device;
+        try {
+            STATS_TIMER(kDistances);
+            device = devices.get(std::move(g), &built);
+        } catch (const std::exception& error) {
+            entry.error = error.what();
+            return;
+        }
+        entry.sharedDevice = !built;
+        entry.deviceMs = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        OutputWriter out;
+        out.setBinary(options.binary);
+        if (!out.open(entry.output)) {
+            return;
+        }
+        WriterSink sink(out);
+        Router router(*device, routerOptions);
+        RoutingResult result;
+        try {
+            if (options.windowed) {
+                result = router.routeWindowed(circuit.logQubits, [&](std::vector<std::pair<int, int>>& gates, int maxCount) {
+                    int count = stream.next(gates, maxCount);
+                    entry.cnots += count;
+                    return count;
+                }, sink);
+            } else {
+                result = router.route(circuit, sink);
+                entry.cnots = circuit.gates.size();
+            }
+        } catch (const std::runtime_error& error) {
+            entry.error = error.what();
+            return;
+        }
+        entry.routeMs = msSince(start);
 
-    BiDict qubitMapping(logQubits);
-    for (int i = 0; i < logQubits; ++i) {
-        qubitMapping.setItem(i, i);
+        start = std::chrono::steady_clock::now();
+        {
+            STATS_TIMER(kFlush);
+            out.close();
+        }
+        entry.flushMs = msSince(start);
+
+        entry.ok = out.ok();
+        entry.swaps = result.swaps;
+    });
+    double wallMs = msSince(batchStart);
+
+    int failed = 0;
+    long long totalSwaps = 0, totalCnots = 0;
+    double parseMs = 0, deviceMs = 0, routeMs = 0, flushMs = 0;
+    for (const auto& entry : entries) {
+        if (!entry.ok) {
+            std::fprintf(stderr, "%s: failed%s%s\n", entry.input.c_str(), entry.error.empty() ? "" : ", ", entry.error.c_str());
+            failed++;
+            continue;
+        }
+        std::fprintf(stderr, "%s: %d CNOT, %d SWAP, parse %.3f ms, device %.3f ms%s, route %.3f ms, flush %.3f ms\n", entry.input.c_str(), entry.cnots, entry.swaps, entry.parseMs, entry.deviceMs, entry.sharedDevice ? " (shared)" : "", entry.routeMs, entry.flushMs);
+        totalSwaps += entry.swaps;
+        totalCnots += entry.cnots;
+        parseMs += entry.parseMs;
+        deviceMs += entry.deviceMs;
+        routeMs += entry.routeMs;
+        flushMs += entry.flushMs;
     }
+    int routed = entries.size() - failed;
+    std::fprintf(stderr, "batch: %d files, %d failed, %lld CNOT, %lld SWAP (avg %.2f), parse %.3f ms, device %.3f ms, route %.3f ms, flush %.3f ms, wall %.3f ms on %d threads\n", (int)entries.size(), failed, totalCnots, totalSwaps, routed ? (double)totalSwaps / routed : 0.0, parseMs, deviceMs, routeMs, flushMs, wallMs, pool.size());
+    STATS_REPORT(stderr);
+    return failed ? 1 : 0;
+}
 
-    std::vector<std::pair<int, std::pair<int, int>>> operations = sabresSwap(gates, dependencies, g, qubitMapping, logQubits, numGates);
-
-    // for (int i = 0; i < logQubits; ++i) {
-    //     std::cout << i + 1 << " " << qubitMapping.getItem(i) + 1 << std::endl;
-    // }
-
-    // printf("%d\n", operations.size());
-
-    for (const auto& op : operations) {
-        if (op.first == 1) {
-            std::cout << "CNOT q" << op.second.first + 1 << " q" << op.second.second + 1 << '\n';
+int main(int argc, char** argv) {
+    auto processStart = std::chrono::steady_clock::now();
+    std::vector<std::string> inputPaths;
+    RunOptions options;
+    bool timing = false;
+    DeviceOptions deviceOptions;
+    RouterOptions routerOptions;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--timing") == 0) {
+            timing = true;
+        } else if (parseRouterFlag(argc, argv, i, deviceOptions, routerOptions)) {
+            continue;
+        } else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            // stream the gates through windows of N instead of loading the circuit
+            options.windowed = true;
+            routerOptions.window = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            // batch mode output directory
+            options.outDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            // wall-clock budget in ms for the whole run (per file in batch mode)
+            options.deadlineMs = std::max(0.0, std::atof(argv[++i]));
+            routerOptions.deadline = options.deadlineMs * (1 - kOutputShare) / 1000;
+        } else if (std::strcmp(argv[i], "--binary") == 0) {
+            // write results in the binary format of binary_format.h
+            options.binary = true;
         } else {
-            std::cout << "SWAP q" << op.second.first + 1 << " q" << op.second.second + 1 << '\n';
+            inputPaths.push_back(argv[i]);
         }
     }
 
-    return 0;
-}
-
-std::vector<std::vector<int>> getFrequencyMatrix(const std::vector<std::pair<int, int>>& gates, int n) {
-    std::vector<std::vector<int>> freqeuncy(n, std::vector<int>(n, 0));
-    for(const auto& gate : gates) {
-        freqeuncy[gate.first][gate.second]++;
-        freqeuncy[gate.second][gate.first]++;
+    std::error_code error;
+    if (inputPaths.size() > 1 || (inputPaths.size() == 1 && std::filesystem::is_directory(inputPaths[0], error))) {
+        options.threads = routerOptions.threads;
+        return runBatch(inputPaths, options, deviceOptions, routerOptions);
     }
-    return freqeuncy;
-}
+    std::string inputPath = inputPaths.empty() ? "" : inputPaths[0];
 
-
-std::vector<int> sortQubits(const std::vector<std::vector<int>>& F, int logQubits) {
-    std::vector<int> queue;
-    std::vector<int> Fsum(F.size(), 0);
-    std::unordered_set<int> qubits(logQubits);
-    for (int i = 0; i < logQubits; i++) {
-        qubits.insert(i);
+    InputBuffer input;
+    if (!input.open(inputPath)) {
+        std::fprintf(stderr, "cannot open %s\n", inputPath.c_str());
+        return 1;
     }
 
-    for(int i=0;i<F.size();i++) {
-        for(const auto& freqeuncy : F[i]) {
-            // printf("%d ", freqeuncy);
-            Fsum[i] += freqeuncy;
+    CircuitHeader header;
+    Circuit circuit;
+    Graph g;
+    ParseStats parseStats;
+    CircuitStream stream(input);
+    {
+        STATS_TIMER(kParse);
+        if (options.windowed ? !stream.open(header, g) : !readCircuit(input, header, circuit.gates, circuit.dependencies, g, &parseStats)) {
+            std::fprintf(stderr, "malformed input\n");
+            return 1;
         }
-        // printf("\n");
     }
-
-    while(!qubits.empty()) {
-        std::pair<int, int> best_qubit = std::make_pair(-1, INT_MAX);
-        for(const auto& qubit : qubits) {
-            if(Fsum[qubit] < best_qubit.second) {
-                best_qubit.second = Fsum[qubit];
-                best_qubit.first = qubit;
-            }
-        }
-        assert(best_qubit.second < INT_MAX);
-        queue.push_back(best_qubit.first);
-        qubits.erase(best_qubit.first);
-        for(int j=0;j<Fsum.size();j++) {
-            Fsum[j] -= F[j][best_qubit.first];
-        }
+    if (timing && !options.windowed) {
+        parseStats.report(stderr);
     }
-
-    std::reverse(queue.begin(), queue.end());
-
-    // for(auto i : queue) {
-    //     printf("%d ", i);
-    // }
-    // printf("\n");
-
-    return queue;
-}
-
-void allocateQubit(const std::vector<std::pair<int, int>>& gates, const std::vector<std::vector<int>>& allPairDistance, const Graph& g, BiDict& qubitMapping, int logQubits) {
-    std::vector<std::vector<int>> F = getFrequencyMatrix(gates, logQubits);
-    std::vector<int> queue = sortQubits(F, logQubits);
-    int maxInDegree = g.maxInDegree();
-    std::unordered_set<int> phyQubits(logQubits);
-    for (int i = 0; i < logQubits; i++) {
-        phyQubits.insert(i);
+    circuit.logQubits = header.logQubits;
+
+    auto distStart = std::chrono::steady_clock::now();
+    Device device = [&] {
+        STATS_TIMER(kDistances);
+        return Device(std::move(g), deviceOptions);
+    }();
+    DistanceOracle allPairDistance = device.distances();
+    if (timing) {
+        double ms = msSince(distStart);
+        std::fprintf(stderr, "distances: %.3f ms (%s)\n", ms, allPairDistance.isMapped() ? "mapped from cache" : allPairDistance.isLazy() ? "lazy rows" : "computed");
     }
 
-    qubitMapping.setItem(queue[0], maxInDegree);
-    // printf("%d->%d\n", queue[0], qubitMapping.getItem(queue[0]));
-    phyQubits.erase(maxInDegree);
-
-    for(int i=1; i < queue.size(); i++) {
-        int bestScore = INT_MAX, bestQubit = -1;
-        // printf("add qubit %d\n", queue[i]);
-        for(const auto& phyQubit : phyQubits) {
-            int score = 0;
-            // assign (phyqubit, queue[i])
-            // check the add score queue[0] ... queue[i -1], queue[i]
-            for(int j=0;j<i;j++) {
-                score += F[j][i] * allPairDistance[qubitMapping.getItem(queue[j])][phyQubit];
-            }
-            // printf("%d->%d, score %d\n", queue[i], phyQubit, score);
-            if(score < bestScore) {
-                bestScore = score;
-                bestQubit = phyQubit;
-            }
-
-        }
-        // printf("assign %d->%d\n", queue[i], bestQubit);
-        qubitMapping.setItem(queue[i], bestQubit);
-        phyQubits.erase(bestQubit);
+    if (options.deadlineMs > 0) {
+        // parsing and the distance table already spent part of the budget
+        double left = options.deadlineMs * (1 - kOutputShare) - msSince(processStart);
+        routerOptions.deadline = std::max(left, 1e-3) / 1000;
     }
-}
-
-std::vector<std::pair<int, std::pair<int, int>>> sabresSwap(const std::vector<std::pair<int, int>>& gates, const std::vector<std::pair<int, int>>& dependencies, const Graph& g, BiDict& qubitMapping, int logQubits, int numGates) {
-    std::vector<std::vector<int>> dependencyGraph(numGates);
-    std::vector<int> inDegree(numGates, 0);
 
-    std::vector<std::vector<int>> allPairDistance = g.allPairDistances();
-    
-    if(true) {
-        allocateQubit(gates, allPairDistance, g, qubitMapping, logQubits);
-    } else {
-        // random assign qubit mapping
-        for (int i = 0; i < logQubits; ++i) {
-            qubitMapping.setItem(i, i);
+    OutputWriter out(STDOUT_FILENO);
+    out.setBinary(options.binary);
+    WriterSink sink(out);
+    Router router(device, routerOptions);
+    RoutingResult result;
+    try {
+        if (options.windowed) {
+            result = router.routeWindowed(circuit.logQubits, [&](std::vector<std::pair<int, int>>& gates, int maxCount) {
+                return stream.next(gates, maxCount);
+            }, sink);
+        } else {
+            result = router.route(circuit, sink);
         }
+    } catch (const std::runtime_error& error) {
+        std::fprintf(stderr, "cannot route: %s\n", error.what());
+        return 1;
     }
-
-    for (int i = 0; i < logQubits; ++i) {
-        std::cout << i + 1 << ' ' << qubitMapping.getItem(i) + 1 << '\n';
+    if (timing && routerOptions.trials > 1 && routerOptions.deadline <= 0) {
+        std::fprintf(stderr, "trials: %d, best %d SWAP\n", routerOptions.trials, result.swaps);
     }
-
-    for (const auto& dependency : dependencies) {
-        int u = dependency.first;
-        int v = dependency.second;
-        dependencyGraph[u].push_back(v);
-        inDegree[v]++;
+    if (routerOptions.deadline > 0 && !options.windowed) {
+        std::fprintf(stderr, "deadline: %.3f ms budget, placement %.3f ms, first pass %.3f ms (%d SWAP), improvement %.3f ms (%d passes, %d improved, best %d SWAP)\n", options.deadlineMs, result.placementSeconds * 1000, result.firstPassSeconds * 1000, result.firstPassSwaps, result.improveSeconds * 1000, result.improvementPasses, result.improvements, result.swaps);
     }
 
-    std::vector<std::pair<int, std::pair<int, int>>> operations;
-
-    std::queue<int> checkQueue;
-    // std::unordered_set<int> executableQueue;
-    std::vector<int> executableQueue;
-    std::vector<int> futureQueue;
-
-    // find all gate id with no dependency
-    for (int idx = 0; idx < numGates; idx++) {
-        if (inDegree[idx] == 0) {
-            checkQueue.push(idx);
-        }
+    if (timing && allPairDistance.isLazy()) {
+        std::fprintf(stderr, "distance cache: %d rows, %zu hits, %zu misses\n", allPairDistance.cachedRows(), result.distanceHits, result.distanceMisses);
     }
-    
-
-    int a_cnt = 2;
-    while (true) {
-        // printf("check queue size %d\n", checkQueue.size());
-
-        while (!checkQueue.empty()) {
-            int candidate = checkQueue.front();
-            checkQueue.pop();
-            // printf("check candidate %d\n", candidate + 1);
-            int logSrc = gates[candidate].first;
-            int logDst = gates[candidate].second;
-            if (allPairDistance[qubitMapping.getItem(logSrc)][qubitMapping.getItem(logDst)] == 1) {
-                // printf("done candidate %d, (%d, %d)\n", candidate, logSrc, logDst);
-                operations.push_back(std::make_pair(1, std::make_pair(logSrc, logDst)));
-
-                for (int v : dependencyGraph[candidate]) {
-                    inDegree[v]--;
-                    if (inDegree[v] == 0) {
-                        // printf("new candidate %d\n", v + 1);
-                        checkQueue.push(v);
-                    }
-                }
-
-            } else {
-                // printf("new executable %d\n", candidate + 1);
-                // executableQueue.insert(candidate);
-                executableQueue.push_back(candidate);
-            }
-
-            // printf("check queue size %d\n", checkQueue.size());
-        }
-
-        if (executableQueue.empty()) {
-            break;
-        }
-
-
 
-        futureQueue.clear();
-        std::vector<std::pair<int, int>> bestSwaps;
-        std::pair<int, int> bestSwap;
-        std::pair<int, int> punishSwap = std::make_pair(-1, -1);
-
-        std::unordered_map<int, int> swapMap;
-        std::unordered_map<int, int> futureSwapMap;
-        std::vector<std::pair<std::pair<int, int>, std::vector<int>>> candidateSwaps(executableQueue.size() * 2);
-
-        int index = 0;
-        for (const int& candidate : executableQueue) {
-            int logSrc = gates[candidate].first;
-            int logDst = gates[candidate].second;
-            int phySrc = qubitMapping.getItem(logSrc);
-            int phyDst = qubitMapping.getItem(logDst);
-            swapMap[logSrc] = candidate;
-            swapMap[logDst] = candidate;
-            // printf("%d %d ", logSrc, logDst);
-            
-            for (int neighbor : dependencyGraph[candidate]) {
-                if (inDegree[neighbor] == 1) {
-                    futureQueue.push_back(neighbor);
-                    int logSrc = gates[neighbor].first;
-                    int logDst = gates[neighbor].second;
-                    futureSwapMap[logSrc] = neighbor;
-                    futureSwapMap[logDst] = neighbor;
-                }
-            }
-
-            candidateSwaps[index].first = std::make_pair(logSrc, logDst);
-            for (int neighbor : g.getNeighbor(phySrc)) {
-                candidateSwaps[index].second.push_back(qubitMapping.getReverseItem(neighbor));
-            }
-            index++;
-
-            candidateSwaps[index].first = std::make_pair(logDst, logSrc);
-            for (int neighbor : g.getNeighbor(phyDst)) {
-                candidateSwaps[index].second.push_back(qubitMapping.getReverseItem(neighbor));
-            }
-            index++;
-        }
-        // printf("\n");
-
-        // for (int candidate : futureQueue) {
-            // printf("%d %d ", gates[candidate].first, gates[candidate].second);
-        // }
-        // printf("\n");
-
-        int currentScore, bestScore = INT_MAX;
-        bestSwaps.clear();
-
-        for(const auto& qubit : candidateSwaps) {
-            auto mainGate = qubit.first;
-            // we swap mainGate.first and neighbor
-            for (int neighbor : qubit.second) {
-                auto swap = std::make_pair(mainGate.first, neighbor);
-                if(punishSwap == swap || (punishSwap.second == swap.first && punishSwap.first == swap.second)) {
-                    break;
-                }
-                // printf("logSrc %d, neighbor %d\n", mainGate.first, neighbor);
-                auto itSwap = swapMap.find(neighbor), itFSwapSrc = futureSwapMap.find(mainGate.first), itFSwapDst = futureSwapMap.find(neighbor);
-                int distance = 0, futureDistance = 0;
-                if (itSwap != swapMap.end()) {
-                    auto gate = gates[itSwap->second];
-                    distance -= allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a friend (%d, %d), distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)]);
-                }
-                if (itFSwapSrc != futureSwapMap.end()) {
-                    auto gate = gates[itFSwapSrc->second];
-                    futureDistance -= allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a future friend (%d, %d), distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)]);
-                }
-                if (itFSwapDst != futureSwapMap.end()) {
-                    auto gate = gates[itFSwapDst->second];
-                    futureDistance -= allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a future friend (%d, %d), distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)]);
-                }
-                distance -= allPairDistance[qubitMapping.getItem(mainGate.first)][qubitMapping.getItem(mainGate.second)];
-                // printf("has a friend (%d, %d) distance %d\n", mainGate.first, mainGate.second, allPairDistance[qubitMapping.getItem(mainGate.first)][qubitMapping.getItem(mainGate.second)]);
-
-                swapQubit(qubitMapping, swap);
-
-                if (itSwap != swapMap.end()) {
-                    auto gate = gates[itSwap->second];
-                    distance += allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a friend (%d, %d), distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)]);
-                }
-                if (itFSwapSrc != futureSwapMap.end()) {
-                    auto gate = gates[itFSwapSrc->second];
-                    futureDistance += allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a future friend (%d, %d), distance %d, now distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)], futureDistance);
-                }
-                if (itFSwapDst != futureSwapMap.end()) {
-                    auto gate = gates[itFSwapDst->second];
-                    futureDistance += allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)];
-                    // printf("has a future friend (%d, %d), distance %d, now distance %d\n", gate.first, gate.second, allPairDistance[qubitMapping.getItem(gate.first)][qubitMapping.getItem(gate.second)], futureDistance);
-                }
-                distance += allPairDistance[qubitMapping.getItem(mainGate.first)][qubitMapping.getItem(mainGate.second)];
-                // printf("has a friend (%d, %d) distance %d\n", mainGate.first, mainGate.second, allPairDistance[qubitMapping.getItem(mainGate.first)][qubitMapping.getItem(mainGate.second)]);
-
-                swapQubit(qubitMapping, swap);
-
-                // printf("swap (%d, %d), score %d, future score %d\n", mainGate.first, neighbor, distance, futureDistance);
-
-                currentScore = (2 * distance + futureDistance);
-                if (currentScore < bestScore) {
-                    bestScore = currentScore;
-                    bestSwaps.clear();
-                    bestSwaps.push_back(swap);
-                    // printf("clear, (%d, %d) push into best swap\n", swap.first, swap.second);
-                } else if (currentScore == bestScore) {
-                    bestSwaps.push_back(swap);
-                    // printf("(%d, %d) push into best swap\n", swap.first, swap.second);
-                }
-                
-            }
-        }
-
-        int idx = std::rand() % bestSwaps.size();
-        bestSwap = bestSwaps[idx];
-        punishSwap = bestSwap;
-
-        // printf("best swap (%d, %d), score %d\n", bestSwap.first, bestSwap.second, bestScore);
-        swapQubit(qubitMapping, bestSwap);
-        operations.push_back(std::make_pair(0, bestSwap));
-
-        // if(executableQueue.size() > 30) {
-        //     continue;
-        // }
-
-        for (int gate : executableQueue) {
-            checkQueue.push(gate);
-        }
-        executableQueue.clear();
+    bool written;
+    {
+        STATS_TIMER(kFlush);
+        written = out.close();
     }
-
-    return operations;
-}
\ No newline at end of file
+    STATS_REPORT(stderr);
+    return written ? 0 : 1;
+}
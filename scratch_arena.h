@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "span.h"
+
+// Monotonic bump allocator for scratch data that lives for one loop
+// iteration. reset() rewinds it. An iteration that outgrows the block spills
+// into overflow blocks, and the next reset() replaces everything with one
+// block big enough for that iteration, so steady-state iterations never
+// touch the heap. Only trivially destructible types may be allocated.
+class ScratchArena {
+private:
+    static constexpr size_t kAlign = 16;
+
+    std::unique_ptr<unsigned char[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+    size_t overflowBytes = 0;
+
+public:
+    explicit ScratchArena(size_t bytes = 1 << 16) : block(new unsigned char[bytes]), capacity(bytes) {}
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    template <class T>
+    Span<T> alloc(int count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        static_assert(alignof(T) <= kAlign, "over-aligned type");
+        size_t bytes = (sizeof(T) * std::max(count, 0) + kAlign - 1) & ~(kAlign - 1);
+        unsigned char* p;
+        if (used + bytes <= capacity) {
+            p = block.get() + used;
+            used += bytes;
+        } else {
+            overflow.emplace_back(new unsigned char[bytes]);
+            overflowBytes += bytes;
+            p = overflow.back().get();
+        }
+        return Span<T>(reinterpret_cast<T*>(p), count);
+    }
+
+    // allocate count copies of value
+    template <class T>
+    Span<T> alloc(int count, const T& value) {
+        Span<T> span = alloc<T>(count);
+        std::fill(span.begin(), span.end(), value);
+        return span;
+    }
+
+    // invalidates every span handed out since the previous reset
+    void reset() {
+        if (!overflow.empty()) {
+            capacity = std::max(2 * capacity, used + overflowBytes);
+            block.reset(new unsigned char[capacity]);
+            overflow.clear();
+            overflowBytes = 0;
+        }
+        used = 0;
+    }
+
+    size_t bytes() const {
+        return capacity;
+    }
+};
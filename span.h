@@ -0,0 +1,37 @@
+#pragma once
+
+// Non-owning view of count contiguous elements.
+template <class T>
+class Span {
+private:
+    T* first = nullptr;
+    int count = 0;
+
+public:
+    Span() = default;
+    Span(T* first, int count) : first(first), count(count) {}
+
+    T* data() const {
+        return first;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    T& operator[](int i) const {
+        return first[i];
+    }
+
+    T* begin() const {
+        return first;
+    }
+
+    T* end() const {
+        return first + count;
+    }
+};
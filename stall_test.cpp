@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "router.h"
+
+// Routes random circuits on a grid device with small stall limits and checks
+// the bound sabresSwap documents: at most stallLimit + diameter - 1 SWAPs
+// between two points of progress, progress being a gate executing or the
+// summed front distance reaching a new low. Every CNOT must also land on
+// coupled qubits and be ready. A far gate on a line checks that SWAPs which
+// keep closing the distance never hand over to the fallback.
+
+const int kRows = 6, kCols = 6;
+
+// tracks the layout, the front of the circuit and the longest SWAP run
+// without progress
+class CheckingSink : public OperationSink {
+private:
+    const DistanceOracle& distances;
+    const Circuit& circuit;
+    const GateDag& dag;
+    std::vector<int> inDegree;
+    std::vector<int> front;
+    BiDict mapping;
+    int run = 0;
+    int bestFrontDistance = 0;
+
+    int frontDistance() const {
+        int sum = 0;
+        for (int gate : front) {
+            sum += distances[mapping.getItem(circuit.gates[gate].first)][mapping.getItem(circuit.gates[gate].second)];
+        }
+        return sum;
+    }
+
+public:
+    int longestRun = 0;
+    int cnots = 0;
+    bool coupled = true;
+    bool ready = true;
+    std::vector<std::pair<int, int>> swaps;
+
+    CheckingSink(const DistanceOracle& distances, const Circuit& circuit, const GateDag& dag) : distances(distances), circuit(circuit), dag(dag), inDegree(dag.inDegree) {
+        for (int gate = 0; gate < (int)circuit.gates.size(); gate++) {
+            if (inDegree[gate] == 0) {
+                front.push_back(gate);
+            }
+        }
+    }
+
+    void layout(const BiDict& initialMapping) override {
+        mapping = initialMapping;
+        bestFrontDistance = frontDistance();
+    }
+
+    void operation(int type, int a, int b) override {
+        if (type == 0) {
+            swapQubit(mapping, std::make_pair(a, b));
+            swaps.push_back(std::make_pair(a, b));
+            int sum = frontDistance();
+            if (sum < bestFrontDistance) {
+                bestFrontDistance = sum;
+                run = 0;
+            } else {
+                longestRun = std::max(longestRun, ++run);
+            }
+            return;
+        }
+        if (distances[mapping.getItem(a)][mapping.getItem(b)] != 1) {
+            coupled = false;
+        }
+        auto gate = std::find_if(front.begin(), front.end(), [&](int g) {
+            return std::minmax(circuit.gates[g].first, circuit.gates[g].second) == std::minmax(a, b);
+        });
+        if (gate == front.end()) {
+            ready = false;
+            return;
+        }
+        int done = *gate;
+        front.erase(gate);
+        for (int v : dag.successors[done]) {
+            if (--inDegree[v] == 0) {
+                front.push_back(v);
+            }
+        }
+        cnots++;
+        run = 0;
+        bestFrontDistance = frontDistance();
+    }
+};
+
+// dependencies from last use per qubit, as the testset generator builds them
+static Circuit randomCircuit(int logQubits, int numGates, unsigned seed) {
+    std::mt19937 rng(seed);
+    Circuit circuit;
+    circuit.logQubits = logQubits;
+    std::vector<int> lastUse(logQubits, -1);
+    for (int i = 0; i < numGates; i++) {
+        int a = rng() % logQubits;
+        int b = (a + 1 + rng() % (logQubits - 1)) % logQubits;
+        circuit.gates.push_back(std::make_pair(a, b));
+        if (lastUse[a] != -1) {
+            circuit.dependencies.push_back(std::make_pair(lastUse[a], i));
+        }
+        if (lastUse[b] != -1 && lastUse[b] != lastUse[a]) {
+            circuit.dependencies.push_back(std::make_pair(lastUse[b], i));
+        }
+        lastUse[a] = lastUse[b] = i;
+    }
+    return circuit;
+}
+
+// one gate between the ends of a line, from the identity layout: every
+// heuristic SWAP brings its qubits closer, so a stall limit of 1 must route
+// exactly as an unlimited one would
+static int improvingSwaps() {
+    const int length = 12;
+    std::vector<std::pair<int, int>> links;
+    for (int i = 0; i + 1 < length; i++) {
+        links.push_back(std::make_pair(i, i + 1));
+    }
+    Device device(Graph(length, links));
+    DistanceOracle distances = device.distances();
+    Circuit circuit;
+    circuit.logQubits = length;
+    circuit.gates.push_back(std::make_pair(0, length - 1));
+    GateDag dag(circuit.dependencies, circuit.gates.size());
+
+    std::vector<std::pair<int, int>> swaps[2];
+    int stallLimits[2] = {1, 1 << 30};
+    int failures = 0;
+    for (int i = 0; i < 2; i++) {
+        BiDict mapping(length);
+        for (int q = 0; q < length; q++) {
+            mapping.setItem(q, q);
+        }
+        std::mt19937 rng(7);
+        CheckingSink sink(distances, circuit, dag);
+        sink.layout(mapping);
+        sabresSwap(circuit.gates, dag, device.graph(), distances, mapping, rng, sink, nullptr, nullptr, stallLimits[i]);
+        if (sink.cnots != 1 || !sink.coupled || sink.longestRun != 0 || (int)sink.swaps.size() != length - 2) {
+            std::fprintf(stderr, "line, stall limit %d: %zu SWAPs, %d without progress, %d CNOTs\n", stallLimits[i], sink.swaps.size(), sink.longestRun, sink.cnots);
+            failures++;
+        }
+        swaps[i] = sink.swaps;
+    }
+    if (swaps[0] != swaps[1]) {
+        std::fprintf(stderr, "line: stall limit 1 fell back although every SWAP made progress\n");
+        failures++;
+    }
+    std::printf("line: %zu SWAPs at stall limit 1, %zu unlimited\n", swaps[0].size(), swaps[1].size());
+    return failures;
+}
+
+int main() {
+    std::vector<std::pair<int, int>> links;
+    for (int r = 0; r < kRows; r++) {
+        for (int c = 0; c < kCols; c++) {
+            int node = r * kCols + c;
+            if (c + 1 < kCols) {
+                links.push_back(std::make_pair(node, node + 1));
+            }
+            if (r + 1 < kRows) {
+                links.push_back(std::make_pair(node, node + kCols));
+            }
+        }
+    }
+    Device device(Graph(kRows * kCols, links));
+    DistanceOracle distances = device.distances();
+    int diameter = (kRows - 1) + (kCols - 1);
+
+    int failures = 0;
+    bool fallback = false;
+    for (int stallLimit : {1, 2, 4, 8}) {
+        int longestRun = 0;
+        for (unsigned seed = 1; seed <= 5; seed++) {
+            Circuit circuit = randomCircuit(kRows * kCols, 2000, seed);
+            GateDag dag(circuit.dependencies, circuit.gates.size());
+            RouterOptions options;
+            options.threads = 1;
+            options.seed = seed;
+            options.stallLimit = stallLimit;
+            Router router(device, options);
+            CheckingSink sink(distances, circuit, dag);
+            router.route(circuit, sink);
+
+            if (sink.cnots != (int)circuit.gates.size() || !sink.coupled || !sink.ready) {
+                std::fprintf(stderr, "stall limit %d, seed %u: %d of %zu CNOTs routed, %s, %s\n", stallLimit, seed, sink.cnots, circuit.gates.size(), sink.coupled ? "all coupled" : "some on uncoupled qubits", sink.ready ? "all ready" : "some not ready");
+                failures++;
+            }
+            if (sink.longestRun > stallLimit + diameter - 1) {
+                std::fprintf(stderr, "stall limit %d, seed %u: %d SWAPs without progress, bound %d\n", stallLimit, seed, sink.longestRun, stallLimit + diameter - 1);
+                failures++;
+            }
+            longestRun = std::max(longestRun, sink.longestRun);
+        }
+        // a run longer than the limit can only come from the shortest-path fallback
+        fallback = fallback || longestRun > stallLimit;
+        std::printf("stall limit %d: longest SWAP run without progress %d, bound %d\n", stallLimit, longestRun, stallLimit + diameter - 1);
+    }
+    if (!fallback) {
+        std::fprintf(stderr, "fallback never exercised\n");
+        failures++;
+    }
+    failures += improvingSwaps();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent fork-join pool. parallelFor hands out the indices 0..count-1
+// to the workers and the calling thread, and returns once all are done.
+// Only one parallelFor may run on a pool at a time.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextIndex{0};
+    int busy = 0;
+    unsigned generation = 0;
+    bool stopping = false;
+
+    void drain(const std::function<void(int)>& fn, int count) {
+        for (int i = nextIndex++; i < count; i = nextIndex++) {
+            fn(i);
+        }
+    }
+
+    void workerLoop() {
+        unsigned seen = 0;
+        while (true) {
+            const std::function<void(int)>* fn;
+            int count;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+                fn = job;
+                count = jobCount;
+            }
+            drain(*fn, count);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0) {
+                    finished.notify_one();
+                }
+            }
+        }
+    }
+
+public:
+    // threads <= 0 uses every hardware thread; the caller counts as one of them
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    int size() const {
+        return workers.size() + 1;
+    }
+
+    void parallelFor(int count, const std::function<void(int)>& fn) {
+        if (workers.empty() || count <= 1) {
+            for (int i = 0; i < count; i++) {
+                fn(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            nextIndex = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        drain(fn, count);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return busy == 0; });
+    }
+};
+
+// Runs a fixed batch of coarse, independent tasks. Each worker starts on its
+// own round-robin share of the task ids and steals from the front of the
+// other workers' queues once its own runs dry.
+class WorkStealingPool {
+private:
+    int threads;
+
+public:
+    // threads <= 0 uses every hardware thread
+    explicit WorkStealingPool(int threads = 0) : threads(threads) {
+        if (this->threads <= 0) {
+            this->threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    int size() const {
+        return threads;
+    }
+
+    void run(int count, const std::function<void(int)>& fn) {
+        int workerCount = std::max(1, std::min(threads, count));
+        struct Queue {
+            std::mutex mutex;
+            std::deque<int> tasks;
+        };
+        std::vector<Queue> queues(workerCount);
+        for (int task = 0; task < count; task++) {
+            queues[task % workerCount].tasks.push_back(task);
+        }
+
+        auto take = [&](int self) {
+            for (int k = 0; k < workerCount; k++) {
+                Queue& queue = queues[(self + k) % workerCount];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty()) {
+                    int task;
+                    if (k == 0) {
+                        task = queue.tasks.back();
+                        queue.tasks.pop_back();
+                    } else {
+                        task = queue.tasks.front();
+                        queue.tasks.pop_front();
+                    }
+                    return task;
+                }
+            }
+            return -1;
+        };
+        auto worker = [&](int self) {
+            for (int task = take(self); task != -1; task = take(self)) {
+                fn(task);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 1; i < workerCount; i++) {
+            pool.emplace_back(worker, i);
+        }
+        worker(0);
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+};
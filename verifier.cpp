@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "csr_adjacency.h"
+#include "fast_input.h"
+#include "thread_pool.h"
+
+// Native counterpart of veritfier.py. Checks a routed result against its
+// testcase in near-linear time, O(g log p + s log d) for g gates over p
+// distinct qubit pairs and s SWAPs on a device of maximum degree d, since
+// gate pair and coupling lookups are binary searches: the initial mapping is
+// a valid injection, every CNOT and SWAP acts on coupled physical qubits,
+// every gate runs exactly once after all of its dependencies, and repeated
+// identical gate pairs are matched to whichever instance is ready.
+
+struct Testcase {
+    CircuitHeader header;
+    std::vector<std::pair<int, int>> gates;
+    std::vector<std::pair<int, int>> dependencies;
+    // sorted neighbour lists of the coupling graph
+    CsrAdjacency links;
+    // dependency successors
+    CsrAdjacency successors;
+    std::vector<int> inDegree;
+    // gate ids grouped by unordered qubit pair, pairs numbered in key order
+    std::vector<int> pairOf;
+    std::vector<long long> pairKeys;
+
+    bool coupled(int a, int b) const {
+        if (a < 0 || b < 0 || a >= header.phyQubits || b >= header.phyQubits) {
+            return false;
+        }
+        Span<const int> neighbors = links[a];
+        return std::binary_search(neighbors.begin(), neighbors.end(), b);
+    }
+
+    long long pairKey(int a, int b) const {
+        return (long long)std::min(a, b) * header.logQubits + std::max(a, b);
+    }
+
+    // pair id of the logical qubits a and b, -1 if no gate uses them
+    int pairId(int a, int b) const {
+        long long key = pairKey(a, b);
+        auto it = std::lower_bound(pairKeys.begin(), pairKeys.end(), key);
+        return it != pairKeys.end() && *it == key ? it - pairKeys.begin() : -1;
+    }
+};
+
+static bool loadTestcase(const std::string& path, Testcase& test, std::string& error) {
+    InputBuffer input;
+    std::vector<std::pair<int, int>> linkList;
+    if (!input.open(path) || !readCircuit(input, test.header, test.gates, test.dependencies, linkList)) {
+        error = "cannot read testcase";
+        return false;
+    }
+    const CircuitHeader& h = test.header;
+    for (const auto& gate : test.gates) {
+        if (gate.first < 0 || gate.second < 0 || gate.first >= h.logQubits || gate.second >= h.logQubits) {
+            error = "gate qubit out of range";
+            return false;
+        }
+    }
+    for (const auto& dependency : test.dependencies) {
+        if (dependency.first < 0 || dependency.second < 0 || dependency.first >= h.numGates || dependency.second >= h.numGates) {
+            error = "dependency out of range";
+            return false;
+        }
+    }
+    for (const auto& edge : linkList) {
+        if (edge.first < 0 || edge.second < 0 || edge.first >= h.phyQubits || edge.second >= h.phyQubits) {
+            error = "link out of range";
+            return false;
+        }
+    }
+
+    // both directions of every link, sorted, so each node's neighbours come out sorted
+    std::vector<std::pair<int, int>> arcs;
+    arcs.reserve(2 * linkList.size());
+    for (const auto& edge : linkList) {
+        arcs.push_back(edge);
+        arcs.emplace_back(edge.second, edge.first);
+    }
+    std::sort(arcs.begin(), arcs.end());
+    test.links = CsrAdjacency(h.phyQubits, arcs, CsrAdjacency::kForward);
+    test.successors = CsrAdjacency(h.numGates, test.dependencies, CsrAdjacency::kForward);
+    test.inDegree.assign(h.numGates, 0);
+    for (const auto& dependency : test.dependencies) {
+        test.inDegree[dependency.second]++;
+    }
+
+    // number the distinct unordered pairs by sorting gate ids on them
+    std::vector<int> order(h.numGates);
+    for (int i = 0; i < h.numGates; i++) {
+        order[i] = i;
+    }
+    auto key = [&](int gate) {
+        return test.pairKey(test.gates[gate].first, test.gates[gate].second);
+    };
+    std::sort(order.begin(), order.end(), [&](int x, int y) {
+        return key(x) < key(y);
+    });
+    test.pairOf.assign(h.numGates, -1);
+    test.pairKeys.clear();
+    for (int gate : order) {
+        if (test.pairKeys.empty() || test.pairKeys.back() != key(gate)) {
+            test.pairKeys.push_back(key(gate));
+        }
+        test.pairOf[gate] = test.pairKeys.size() - 1;
+    }
+    return true;
+}
+
+struct VerifyResult {
+    int cnots = 0;
+    int swaps = 0;
+    int depth = 0;
+};
+
+class OutputReader {
+private:
+    const char* cur;
+    const char* last;
+
+    void skipSpace() {
+        while (cur < last && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n')) {
+            cur++;
+        }
+    }
+
+public:
+    OutputReader(const char* begin, const char* end) : cur(begin), last(end) {}
+
+    bool word(std::string& out) {
+        skipSpace();
+        const char* start = cur;
+        while (cur < last && *cur != ' ' && *cur != '\t' && *cur != '\r' && *cur != '\n') {
+            cur++;
+        }
+        out.assign(start, cur);
+        return cur > start;
+    }
+
+    // a decimal number, optionally behind a 'q' prefix
+    bool number(int& value, bool qubit) {
+        skipSpace();
+        if (qubit) {
+            if (cur == last || *cur != 'q') {
+                return false;
+            }
+            cur++;
+        }
+        if (cur == last || (unsigned char)(*cur - '0') > 9) {
+            return false;
+        }
+        long long v = 0;
+        while (cur < last && (unsigned char)(*cur - '0') <= 9) {
+            v = std::min(v * 10 + (*cur - '0'), (long long)1 << 40);
+            cur++;
+        }
+        value = v > (1 << 30) ? -1 : (int)v;
+        return true;
+    }
+};
+
+static bool verifyOutput(const Testcase& test, const char* begin, const char* end, VerifyResult& result, std::string& error) {
+    const CircuitHeader& h = test.header;
+    OutputReader out(begin, end);
+
+    std::vector<int> mapping(h.logQubits, -1);
+    std::vector<char> physUsed(h.phyQubits, 0);
+    for (int i = 0; i < h.logQubits; i++) {
+        int logical, physical;
+        if (!out.number(logical, false) || !out.number(physical, false)) {
+            error = "incomplete initial mapping";
+            return false;
+        }
+        logical--;
+        physical--;
+        if (logical < 0 || logical >= h.logQubits || physical < 0 || physical >= h.phyQubits) {
+            error = "mapping qubit out of range";
+            return false;
+        }
+        if (mapping[logical] != -1 || physUsed[physical]) {
+            error = "mapping is not one-to-one";
+            return false;
+        }
+        mapping[logical] = physical;
+        physUsed[physical] = 1;
+    }
+
+    // ready gates per qubit pair in the order they became ready
+    int numPairs = test.pairKeys.size();
+    std::vector<int> inDegree = test.inDegree;
+    std::vector<int> readyHead(numPairs, 0);
+    std::vector<std::vector<int>> readyByPair(numPairs);
+    int left = h.numGates;
+    for (int gate = 0; gate < h.numGates; gate++) {
+        if (inDegree[gate] == 0) {
+            readyByPair[test.pairOf[gate]].push_back(gate);
+        }
+    }
+
+    std::vector<int> level(h.phyQubits, 0);
+    std::string op;
+    char message[128];
+    while (left > 0) {
+        int a, b;
+        if (!out.word(op) || !out.number(a, true) || !out.number(b, true)) {
+            error = "some gates aren't used";
+            return false;
+        }
+        a--;
+        b--;
+        if (a < 0 || b < 0 || a >= h.logQubits || b >= h.logQubits || a == b) {
+            std::snprintf(message, sizeof(message), "bad operands q%d q%d", a + 1, b + 1);
+            error = message;
+            return false;
+        }
+        int pa = mapping[a], pb = mapping[b];
+        if (!test.coupled(pa, pb)) {
+            std::snprintf(message, sizeof(message), "(%d, %d) are not neighbors, can't do %s", pa + 1, pb + 1, op.c_str());
+            error = message;
+            return false;
+        }
+
+        if (op == "CNOT") {
+            int pair = test.pairId(a, b);
+            if (pair == -1) {
+                std::snprintf(message, sizeof(message), "gate not found: (%d, %d)", std::min(a, b) + 1, std::max(a, b) + 1);
+                error = message;
+                return false;
+            }
+            if (readyHead[pair] == (int)readyByPair[pair].size()) {
+                std::snprintf(message, sizeof(message), "gate (%d, %d) is not ready", std::min(a, b) + 1, std::max(a, b) + 1);
+                error = message;
+                return false;
+            }
+            int gate = readyByPair[pair][readyHead[pair]++];
+            left--;
+            for (int v : test.successors[gate]) {
+                if (--inDegree[v] == 0) {
+                    readyByPair[test.pairOf[v]].push_back(v);
+                }
+            }
+            result.cnots++;
+        } else if (op == "SWAP") {
+            std::swap(mapping[a], mapping[b]);
+            result.swaps++;
+        } else {
+            error = "unknown op type: " + op;
+            return false;
+        }
+        int layer = std::max(level[pa], level[pb]) + 1;
+        level[pa] = level[pb] = layer;
+        result.depth = std::max(result.depth, layer);
+    }
+    return true;
+}
+
+// run command with stdin from inputPath, collecting stdout; false on timeout or failure to start
+static bool runCommand(const std::string& command, const std::string& inputPath, int timeoutSeconds, std::string& output, double& seconds) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        int in = open(inputPath.c_str(), O_RDONLY);
+        int devNull = open("/dev/null", O_WRONLY);
+        if (in < 0 || devNull < 0) {
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(pipeFds[1], STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        setpgid(0, 0);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(pipeFds[1]);
+
+    auto deadline = start + std::chrono::seconds(timeoutSeconds);
+    std::vector<char> chunk(1 << 16);
+    bool timedOut = false;
+    output.clear();
+    while (true) {
+        int waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (waitMs <= 0) {
+            timedOut = true;
+            break;
+        }
+        struct pollfd pfd = {pipeFds[0], POLLIN, 0};
+        if (poll(&pfd, 1, waitMs) <= 0) {
+            continue;
+        }
+        ssize_t got = read(pipeFds[0], chunk.data(), chunk.size());
+        if (got <= 0) {
+            break;
+        }
+        output.append(chunk.data(), got);
+    }
+    close(pipeFds[0]);
+    if (timedOut) {
+        kill(-pid, SIGKILL);
+        kill(pid, SIGKILL);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return !timedOut;
+}
+
+struct CaseOutcome {
+    bool failed = false;
+    bool timedOut = false;
+    VerifyResult result;
+    double runtime = 0;
+    std::string error;
+};
+
+static std::vector<std::string> listDir(const std::string& dir) {
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file()) {
+            names.push_back(entry.path().filename().string());
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// verifier <testcase> [<result>]: check one result file, stdin when omitted
+static int verifyFile(const std::string& testPath, const std::string& resultPath) {
+    auto start = std::chrono::steady_clock::now();
+    Testcase test;
+    std::string error;
+    if (!loadTestcase(testPath, test, error)) {
+        std::printf("%s: %s\n", testPath.c_str(), error.c_str());
+        return 1;
+    }
+    InputBuffer result;
+    if (!result.open(resultPath)) {
+        std::printf("cannot open %s\n", resultPath.c_str());
+        return 1;
+    }
+    VerifyResult counts;
+    bool ok = verifyOutput(test, result.begin(), result.end(), counts, error);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::printf("%s\n%s failed.\n", error.c_str(), testPath.c_str());
+        return 1;
+    }
+    std::printf("%s all OK. %d CNOT, %d SWAP, depth %d, %.3fs\n", testPath.c_str(), counts.cnots, counts.swaps, counts.depth, seconds);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::string exe;
+    std::string testsetPath = "testset";
+    std::vector<std::string> folders;
+    std::vector<std::string> positional;
+    int timeout = 5;
+    int threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--exe") == 0 && i + 1 < argc) {
+            exe = argv[++i];
+        } else if (std::strcmp(argv[i], "--testset_path") == 0 && i + 1 < argc) {
+            testsetPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--folders") == 0) {
+            while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) {
+                folders.push_back(argv[++i]);
+            }
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--thread") == 0 && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (exe.empty()) {
+        if (positional.empty() || positional.size() > 2) {
+            std::fprintf(stderr, "usage: %s <testcase> [<result>]\n       %s --exe CMD [--folders a b] [--testset_path DIR] [--timeout S] [--thread N]\n", argv[0], argv[0]);
+            return 1;
+        }
+        return verifyFile(positional[0], positional.size() == 2 ? positional[1] : "");
+    }
+    if (folders.empty()) {
+        folders.push_back("tiny");
+    }
+
+    std::printf("using %d threads\n", threads);
+    struct Summary {
+        std::string folder;
+        double cnots, swaps, depth, runtime;
+    };
+    std::vector<Summary> summaries;
+    WorkStealingPool pool(threads);
+    for (const auto& folder : folders) {
+        std::string dir = (std::filesystem::path(testsetPath) / folder).string();
+        std::error_code error;
+        if (!std::filesystem::is_directory(dir, error)) {
+            std::printf("error occured: no such folder %s\n", dir.c_str());
+            return 1;
+        }
+        std::vector<std::string> testcases = listDir(dir);
+        std::vector<CaseOutcome> outcomes(testcases.size());
+
+        pool.run(testcases.size(), [&](int task) {
+            CaseOutcome& outcome = outcomes[task];
+            std::string path = (std::filesystem::path(dir) / testcases[task]).string();
+            Testcase test;
+            std::string output;
+            if (!loadTestcase(path, test, outcome.error)) {
+                outcome.failed = true;
+            } else if (!runCommand(exe, path, timeout, output, outcome.runtime)) {
+                outcome.failed = outcome.timedOut = true;
+            } else if (!verifyOutput(test, output.data(), output.data() + output.size(), outcome.result, outcome.error)) {
+                outcome.failed = true;
+            }
+
+            // whole report at once so lines from different workers do not interleave
+            char line[512];
+            if (outcome.timedOut) {
+                std::snprintf(line, sizeof(line), "testcase %s timed out after %d seconds\n", path.c_str(), timeout);
+            } else if (outcome.failed) {
+                std::snprintf(line, sizeof(line), "%s\n%s failed.\n", outcome.error.c_str(), path.c_str());
+            } else {
+                std::snprintf(line, sizeof(line), "%s all OK. %d CNOT, %d SWAP, depth %d, %.3fs\n", path.c_str(), outcome.result.cnots, outcome.result.swaps, outcome.result.depth, outcome.runtime);
+            }
+            std::fputs(line, stdout);
+        });
+
+        std::vector<int> failed;
+        double cnots = 0, swaps = 0, depth = 0, runtime = 0;
+        for (size_t i = 0; i < outcomes.size(); i++) {
+            if (outcomes[i].failed) {
+                failed.push_back(i + 1);
+            } else {
+                cnots += outcomes[i].result.cnots;
+                swaps += outcomes[i].result.swaps;
+                depth += outcomes[i].result.depth;
+                runtime += outcomes[i].runtime;
+            }
+        }
+        if (!failed.empty()) {
+            std::printf("failed testcase: [");
+            for (size_t i = 0; i < failed.size(); i++) {
+                std::printf("%s%d", i ? ", " : "", failed[i]);
+            }
+            std::printf("]\n");
+            return 1;
+        }
+        double n = std::max<size_t>(1, testcases.size());
+        std::printf("%s completed, avg %.3f CNOT, %.3f SWAP, %.3f depth, %.3f seconds\n", folder.c_str(), cnots / n, swaps / n, depth / n, runtime / n);
+        summaries.push_back({folder, cnots / n, swaps / n, depth / n, runtime / n});
+    }
+
+    std::printf("------------------------------------------------------------\n");
+    std::printf("result:\n");
+    for (const auto& summary : summaries) {
+        std::printf("%s: avg %.3f CNOT, %.3f SWAP, %.3f depth, %.3fs\n", summary.folder.c_str(), summary.cnots, summary.swaps, summary.depth, summary.runtime);
+    }
+    return 0;
+}